@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////////
+// Main File:        mem.c - mem allocation and freeing
+// This File:        arena.c
+// Other Files:      mem.h, mem.c
+// Semester:         CS 354 Spring 2019
+//
+// Author:           Bryce Van Camp
+// Email:            bvancamp@wisc.edu
+// CS Login:         bvan-camp
+//
+/////////////////////////// OTHER SOURCES OF HELP //////////////////////////////
+//                   fully acknowledge and credit all sources of help,
+//                   other than Instructors and TAs.
+//
+// Persons:          none
+//
+// Online sources:   none
+//////////////////////////// 80 columns wide ///////////////////////////////////
+
+/*
+ * Arenas hand out memory from chunks taken with Alloc_Mem by bumping a
+ * pointer, and release everything allocated from them at once. Objects from
+ * an arena are never passed to Free_Mem. An arena belongs to one thread at a
+ * time, even on a thread-safe heap.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mem.h"
+
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ROUND_UP(size) (((size) + MEM_ALIGNMENT - 1) / MEM_ALIGNMENT * MEM_ALIGNMENT)
+#define CHUNK_DATA(c) ((char*)(c) + ROUND_UP(sizeof(arena_chunk)))
+
+typedef struct arena_chunk
+{
+	struct arena_chunk *next; // the chunk allocated before this one
+	size_t size;              // bytes of data after the header
+} arena_chunk;
+
+struct arena
+{
+	arena_chunk *chunks; // newest first, the oldest chunk is kept by a reset
+	char *next;          // next free byte of the newest chunk
+	char *end;           // end of the newest chunk
+	size_t chunk_size;
+};
+
+/*
+ * Function for creating an empty arena.
+ * Argument chunk_size: bytes to take from the heap at a time, 0 for
+ * ARENA_CHUNK_SIZE. Larger requests get a chunk of their own.
+ * Returns the arena on success.
+ * Returns NULL if the heap has no room for it.
+ */
+arena* Arena_Create(size_t chunk_size)
+{
+	arena *a = Alloc_Mem(sizeof(arena));
+	if (a == NULL)
+		return NULL;
+
+	a->chunks = NULL;
+	a->next = NULL;
+	a->end = NULL;
+	a->chunk_size = chunk_size != 0 ? ROUND_UP(chunk_size) : ARENA_CHUNK_SIZE;
+	return a;
+}
+
+/*
+ * Function for allocating 'size' bytes from an arena.
+ * Argument a: the arena
+ * Argument size: requested size, rounded up to MEM_ALIGNMENT
+ * Returns the MEM_ALIGNMENT aligned object on success.
+ * Returns NULL if size is 0 or a new chunk couldn't be allocated.
+ */
+void* Arena_Alloc(arena *a, size_t size)
+{
+	if (size == 0 || size > SIZE_MAX / 2)
+		return NULL;
+	size = ROUND_UP(size);
+
+	//the common case, bump the pointer
+	if ((size_t)(a->end - a->next) >= size)
+	{
+		void *ptr = a->next;
+		a->next += size;
+		return ptr;
+	}
+
+	size_t data_size = size > a->chunk_size ? size : a->chunk_size;
+	arena_chunk *chunk = Alloc_Mem(ROUND_UP(sizeof(arena_chunk)) + data_size);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->size = data_size;
+	chunk->next = a->chunks;
+	a->chunks = chunk;
+	a->next = CHUNK_DATA(chunk) + size;
+	a->end = CHUNK_DATA(chunk) + data_size;
+	return CHUNK_DATA(chunk);
+}
+
+/*
+ * Function for freeing everything allocated from an arena in one call.
+ * All chunks but the oldest go back to the heap, the oldest is reused.
+ * Argument a: the arena
+ */
+void Arena_Reset(arena *a)
+{
+	if (a->chunks == NULL)
+		return;
+
+	while (a->chunks->next != NULL)
+	{
+		arena_chunk *chunk = a->chunks;
+		a->chunks = chunk->next;
+		Free_Mem(chunk);
+	}
+
+	a->next = CHUNK_DATA(a->chunks);
+	a->end = CHUNK_DATA(a->chunks) + a->chunks->size;
+}
+
+/*
+ * Function for freeing an arena and everything allocated from it.
+ * Argument a: the arena, may be NULL
+ */
+void Arena_Destroy(arena *a)
+{
+	if (a == NULL)
+		return;
+
+	while (a->chunks != NULL)
+	{
+		arena_chunk *chunk = a->chunks;
+		a->chunks = chunk->next;
+		Free_Mem(chunk);
+	}
+	Free_Mem(a);
+}
@@ -0,0 +1,693 @@
+////////////////////////////////////////////////////////////////////////////////
+// Main File:        bench.c
+// This File:        bench.c
+// Other Files:      mem.h, mem.c
+// Semester:         CS 354 Spring 2019
+//
+// Author:           Bryce Van Camp
+// Email:            bvancamp@wisc.edu
+// CS Login:         bvan-camp
+//
+/////////////////////////// OTHER SOURCES OF HELP //////////////////////////////
+//                   fully acknowledge and credit all sources of help,
+//                   other than Instructors and TAs.
+//
+// Persons:          none
+//
+// Online sources:   none
+//////////////////////////// 80 columns wide ///////////////////////////////////
+
+/*
+ * Runs standard allocator workloads against libmem.so and the C library's
+ * malloc, each on several threads:
+ *   uniform   random slots freed or filled with 16 to 1024 bytes
+ *   powerlaw  the same with sizes from 16 bytes to 64 KiB, each power of two
+ *             half as likely as the one below it
+ *   prodcons  producers allocate and hand their objects to a consumer
+ *             thread that frees them
+ *   larson    slots replaced at random, their arrays passed on to another
+ *             thread every round so most frees are of another thread's objects
+ *   realloc   buffers grown by half again with realloc up to 1 MiB
+ *   scan      a heap fragmented into SCAN_OBJECTS holes per thread, asked for
+ *             blocks too large for any of them, so that every best-fit search
+ *             walks the whole size class spread over the heap, one call for
+ *             every SCAN_COST of the other workloads
+ * and reports for each
+ *   throughput in calls per second,
+ *   p50 and p99 latency of every LATENCY_SAMPLE-th call,
+ *   peak RSS of the process,
+ *   fragmentation, the memory the allocator holds divided by the bytes
+ *   still requested when the workload ends.
+ * Every run is a child process of its own, so each gets a fresh heap and
+ * its own peak RSS. With -o the results are also written as CSV.
+ * Usage: bench [-t threads] [-n calls] [-f flags] [-m map_threshold]
+ *              [-s heap_size] [-w workload] [-a allocator] [-o file.csv]
+ * where flags are the libmem Init_Mem_Flags and calls are per thread. The
+ * scan workload shows what MEM_HUGE_PAGES saves on TLB misses, for example
+ *   bench -w scan -a libmem -t 1 -f 6 -s 256M  against  -f 134, see make hugebench
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define HEAP_SIZE (1024 * 1024)
+#define SLOTS 1024
+#define BUFFERS 16
+#define WINDOW 512
+#define QUEUE_SIZE 256
+#define LARSON_ROUNDS 16
+#define LATENCY_SAMPLE 8
+#define SCAN_OBJECTS 16384
+#define SCAN_SIZE 1100
+#define SCAN_COST 256
+
+/* An allocator under test, called through the same indirection for both */
+typedef struct allocator
+{
+	const char *name;
+	void* (*alloc)(size_t size);
+	void (*release)(void *ptr);
+	void* (*resize)(void *ptr, size_t size);
+	size_t (*footprint)();
+} allocator;
+
+/* Objects handed from a producer to its consumer, single producer and consumer */
+typedef struct queue
+{
+	void *items[QUEUE_SIZE];
+	size_t head; // next item to take, only written by the consumer
+	size_t tail; // next item to fill, only written by the producer
+} queue;
+
+/* A set of slots, owned by one thread at a time */
+typedef struct slot_array
+{
+	void *ptrs[SLOTS];
+	size_t sizes[SLOTS];
+	size_t live; // bytes requested by the filled slots
+} slot_array;
+
+/* One thread of a workload */
+typedef struct worker
+{
+	int id;
+	pthread_t thread;
+	uint32_t seed;
+	long calls;
+	long failed;
+	size_t live;       // bytes it leaves allocated until the run is measured
+	uint32_t *samples; // latencies in ns
+	size_t sample_count;
+	size_t sample_capacity;
+} worker;
+
+/* Result of one run, sent from the child to the parent */
+typedef struct result
+{
+	long calls;
+	long failed;
+	double seconds;
+	uint64_t p50;
+	uint64_t p99;
+	long peak_rss;
+	size_t footprint;
+	size_t live;
+} result;
+
+typedef struct workload
+{
+	const char *name;
+	void* (*run)(void *arg);
+	int paired; // whether threads come in producer/consumer pairs
+} workload;
+
+static const allocator *mem;
+static long calls_per_thread;
+static int thread_count;
+static pthread_barrier_t done_barrier;  // workers and the main thread
+static pthread_barrier_t round_barrier; // workers only
+static slot_array *arrays;
+static queue *queues;
+
+/*
+ * These functions adapt libmem and the C library to the allocator interface.
+ */
+static void Mem_Release(void *ptr)
+{
+	Free_Mem(ptr);
+}
+
+static size_t Mem_Footprint()
+{
+	mem_stats stats;
+	Mem_Stats(&stats);
+	return stats.heap_size + stats.mapped_bytes;
+}
+
+static size_t Libc_Footprint()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.arena + info.hblkhd;
+}
+
+static const allocator allocators[] =
+{
+	{ "libmem", Alloc_Mem, Mem_Release, Realloc_Mem, Mem_Footprint },
+	{ "glibc", malloc, free, realloc, Libc_Footprint },
+};
+
+/*
+ * This inline function returns a monotonic time in nanoseconds.
+ */
+static inline uint64_t Now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/*
+ * This inline function returns the next number of a worker's xorshift
+ * generator.
+ */
+static inline uint32_t Random(worker *w)
+{
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 17;
+	w->seed ^= w->seed << 5;
+	return w->seed;
+}
+
+/*
+ * This inline function records the latency of a sampled call.
+ */
+static inline void Sample(worker *w, uint64_t start)
+{
+	if (w->sample_count < w->sample_capacity)
+		w->samples[w->sample_count++] = Now() - start;
+}
+
+/*
+ * These inline functions call the allocator under test, timing every
+ * LATENCY_SAMPLE-th call of the worker. A new object's first byte is written
+ * so that its page is really used.
+ */
+static inline void* Timed_Alloc(worker *w, size_t size)
+{
+	void *ptr;
+	if (w->calls++ % LATENCY_SAMPLE != 0)
+	{
+		ptr = mem->alloc(size);
+	}
+	else
+	{
+		uint64_t start = Now();
+		ptr = mem->alloc(size);
+		Sample(w, start);
+	}
+	if (ptr == NULL)
+		w->failed++;
+	else
+		*(char*)ptr = 1;
+	return ptr;
+}
+
+static inline void Timed_Free(worker *w, void *ptr)
+{
+	if (w->calls++ % LATENCY_SAMPLE != 0)
+	{
+		mem->release(ptr);
+		return;
+	}
+	uint64_t start = Now();
+	mem->release(ptr);
+	Sample(w, start);
+}
+
+static inline void* Timed_Realloc(worker *w, void *ptr, size_t size)
+{
+	void *new_ptr;
+	if (w->calls++ % LATENCY_SAMPLE != 0)
+	{
+		new_ptr = mem->resize(ptr, size);
+	}
+	else
+	{
+		uint64_t start = Now();
+		new_ptr = mem->resize(ptr, size);
+		Sample(w, start);
+	}
+	if (new_ptr == NULL)
+		w->failed++;
+	else
+		((char*)new_ptr)[size - 1] = 1;
+	return new_ptr;
+}
+
+/*
+ * Function for ending a worker's timed part: waits until every worker is
+ * done and the main thread has measured the heap.
+ */
+static void Hold()
+{
+	pthread_barrier_wait(&done_barrier);
+	pthread_barrier_wait(&done_barrier);
+}
+
+/*
+ * Function for freeing the slots of an array, untimed.
+ */
+static void Empty_Array(slot_array *array)
+{
+	for (int i = 0; i < SLOTS; i++)
+		if (array->ptrs[i] != NULL)
+			mem->release(array->ptrs[i]);
+	memset(array, 0, sizeof(slot_array));
+}
+
+/*
+ * Function for filling or freeing random slots of a worker's own array.
+ * power_law this is whether sizes follow the power law instead of being
+ * uniform
+ */
+static void Churn(worker *w, int power_law)
+{
+	slot_array *array = &arrays[w->id];
+
+	while (w->calls < calls_per_thread)
+	{
+		int k = Random(w) % SLOTS;
+		if (array->ptrs[k] != NULL)
+		{
+			Timed_Free(w, array->ptrs[k]);
+			array->ptrs[k] = NULL;
+			array->live -= array->sizes[k];
+			continue;
+		}
+
+		size_t size;
+		if (power_law)
+		{
+			//each extra trailing zero halves the chance, up to 2^11 times 16
+			int shift = __builtin_ctz(Random(w) | 1 << 11);
+			size = ((size_t)16 << shift) + Random(w) % ((size_t)16 << shift);
+		}
+		else size = 16 + Random(w) % 1009;
+
+		array->ptrs[k] = Timed_Alloc(w, size);
+		if (array->ptrs[k] != NULL)
+		{
+			array->sizes[k] = size;
+			array->live += size;
+		}
+	}
+
+	w->live = array->live;
+	Hold();
+	Empty_Array(array);
+}
+
+static void* Uniform(void *arg)
+{
+	Churn(arg, 0);
+	return NULL;
+}
+
+static void* Power_Law(void *arg)
+{
+	Churn(arg, 1);
+	return NULL;
+}
+
+/*
+ * Function run by both sides of a producer/consumer pair. Even workers
+ * produce: each new object takes the place of the oldest of the last WINDOW
+ * it made, which goes to the queue. Odd workers free what their queue holds
+ * until the producer's NULL arrives.
+ */
+static void* Producer_Consumer(void *arg)
+{
+	worker *w = arg;
+	queue *q = &queues[w->id / 2];
+
+	if (w->id % 2 == 0)
+	{
+		void *window[WINDOW] = { NULL };
+		size_t sizes[WINDOW] = { 0 };
+		size_t live = 0;
+		for (long i = 0; w->calls < calls_per_thread; i++)
+		{
+			size_t size = 16 + Random(w) % 497;
+			void *ptr = Timed_Alloc(w, size);
+			void *old = window[i % WINDOW];
+			size_t old_size = sizes[i % WINDOW];
+			window[i % WINDOW] = ptr;
+			sizes[i % WINDOW] = ptr != NULL ? size : 0;
+			live += sizes[i % WINDOW] - old_size;
+			if (old == NULL)
+				continue;
+
+			//wait for the consumer to make room
+			while (q->tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == QUEUE_SIZE)
+				sched_yield();
+			q->items[q->tail % QUEUE_SIZE] = old;
+			__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+		}
+		while (q->tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == QUEUE_SIZE)
+			sched_yield();
+		q->items[q->tail % QUEUE_SIZE] = NULL;
+		__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+
+		w->live = live;
+		Hold();
+		for (int i = 0; i < WINDOW; i++)
+			if (window[i] != NULL)
+				mem->release(window[i]);
+	}
+	else
+	{
+		while (1)
+		{
+			while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->head)
+				sched_yield();
+			void *ptr = q->items[q->head % QUEUE_SIZE];
+			__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+			if (ptr == NULL)
+				break;
+			Timed_Free(w, ptr);
+		}
+		Hold();
+	}
+	return NULL;
+}
+
+/*
+ * Function for larson-style churn: every call frees a random slot and fills
+ * it again. After each of LARSON_ROUNDS rounds the arrays move on to the
+ * next thread, which frees what the previous one allocated.
+ */
+static void* Larson(void *arg)
+{
+	worker *w = arg;
+	long per_round = calls_per_thread / LARSON_ROUNDS;
+
+	for (int round = 0; round < LARSON_ROUNDS; round++)
+	{
+		slot_array *array = &arrays[(w->id + round) % thread_count];
+		for (long end = w->calls + per_round; w->calls < end; )
+		{
+			int k = Random(w) % SLOTS;
+			if (array->ptrs[k] != NULL)
+			{
+				Timed_Free(w, array->ptrs[k]);
+				array->live -= array->sizes[k];
+			}
+			size_t size = 16 + Random(w) % 497;
+			array->ptrs[k] = Timed_Alloc(w, size);
+			array->sizes[k] = array->ptrs[k] != NULL ? size : 0;
+			array->live += array->sizes[k];
+		}
+		pthread_barrier_wait(&round_barrier);
+	}
+
+	slot_array *array = &arrays[(w->id + LARSON_ROUNDS) % thread_count];
+	w->live = array->live;
+	Hold();
+	Empty_Array(array);
+	return NULL;
+}
+
+/*
+ * Function for growing buffers by half again with realloc; a buffer that
+ * reaches 1 MiB is freed and starts over at 16 bytes.
+ */
+static void* Realloc_Growth(void *arg)
+{
+	worker *w = arg;
+	void *buffers[BUFFERS] = { NULL };
+	size_t sizes[BUFFERS] = { 0 };
+
+	while (w->calls < calls_per_thread)
+	{
+		int k = Random(w) % BUFFERS;
+		if (sizes[k] >= 1024 * 1024)
+		{
+			Timed_Free(w, buffers[k]);
+			buffers[k] = NULL;
+			sizes[k] = 0;
+		}
+
+		size_t size = sizes[k] + sizes[k] / 2 + 16;
+		void *ptr = Timed_Realloc(w, buffers[k], size);
+		if (ptr != NULL)
+		{
+			buffers[k] = ptr;
+			sizes[k] = size;
+		}
+	}
+
+	for (int k = 0; k < BUFFERS; k++)
+		w->live += sizes[k];
+	Hold();
+	for (int k = 0; k < BUFFERS; k++)
+		if (buffers[k] != NULL)
+			mem->release(buffers[k]);
+	return NULL;
+}
+
+/*
+ * Function for timing searches of a fragmented heap. Every other one of
+ * SCAN_OBJECTS objects is freed, leaving holes in the same size class as the
+ * requests but smaller, so each request looks at all of them before it is
+ * carved from the space past the objects. The workers wait for each other's
+ * holes before searching, setting them up counts towards the time but not
+ * the calls.
+ */
+static void* Scan(void *arg)
+{
+	worker *w = arg;
+	void **objects = calloc(SCAN_OBJECTS, sizeof(void*));
+
+	for (int i = 0; i < SCAN_OBJECTS; i++)
+		objects[i] = mem->alloc(SCAN_SIZE);
+	for (int i = 0; i < SCAN_OBJECTS; i += 2)
+	{
+		mem->release(objects[i]);
+		objects[i] = NULL;
+	}
+	pthread_barrier_wait(&round_barrier);
+
+	while (w->calls < calls_per_thread / SCAN_COST)
+	{
+		void *ptr = Timed_Alloc(w, SCAN_SIZE * 7 / 4);
+		if (ptr != NULL)
+			Timed_Free(w, ptr);
+	}
+
+	for (int i = 1; i < SCAN_OBJECTS; i += 2)
+		w->live += objects[i] != NULL ? SCAN_SIZE : 0;
+	Hold();
+	for (int i = 1; i < SCAN_OBJECTS; i += 2)
+		if (objects[i] != NULL)
+			mem->release(objects[i]);
+	free(objects);
+	return NULL;
+}
+
+static const workload workloads[] =
+{
+	{ "uniform", Uniform, 0 },
+	{ "powerlaw", Power_Law, 0 },
+	{ "prodcons", Producer_Consumer, 1 },
+	{ "larson", Larson, 0 },
+	{ "realloc", Realloc_Growth, 0 },
+	{ "scan", Scan, 0 },
+};
+
+static int Compare_Samples(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Function for running one workload on the current allocator, in the child.
+ * The clock stops once every worker is done, before they free what they
+ * still hold, so that the footprint is measured with the live objects.
+ */
+static void Run(const workload *load, result *out)
+{
+	int count = load->paired ? (thread_count < 2 ? 2 : thread_count / 2 * 2) : thread_count;
+	worker *workers = calloc(count, sizeof(worker));
+	arrays = calloc(count, sizeof(slot_array));
+	queues = calloc(count, sizeof(queue));
+	pthread_barrier_init(&done_barrier, NULL, count + 1);
+	pthread_barrier_init(&round_barrier, NULL, count);
+	thread_count = count;
+
+	uint64_t start = Now();
+	for (int i = 0; i < count; i++)
+	{
+		worker *w = &workers[i];
+		w->id = i;
+		w->seed = 2463534242u + i;
+		w->sample_capacity = calls_per_thread / LATENCY_SAMPLE + 2;
+		w->samples = malloc(w->sample_capacity * sizeof(uint32_t));
+		pthread_create(&w->thread, NULL, load->run, w);
+	}
+	pthread_barrier_wait(&done_barrier);
+	out->seconds = (Now() - start) / 1e9;
+	out->footprint = mem->footprint();
+	pthread_barrier_wait(&done_barrier);
+
+	size_t samples = 0;
+	out->calls = 0;
+	out->failed = 0;
+	out->live = 0;
+	for (int i = 0; i < count; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		out->calls += workers[i].calls;
+		out->failed += workers[i].failed;
+		out->live += workers[i].live;
+		samples += workers[i].sample_count;
+	}
+
+	uint32_t *all = malloc((samples + 1) * sizeof(uint32_t));
+	for (int i = 0, n = 0; i < count; n += workers[i].sample_count, i++)
+		memcpy(all + n, workers[i].samples, workers[i].sample_count * sizeof(uint32_t));
+	qsort(all, samples, sizeof(uint32_t), Compare_Samples);
+	out->p50 = samples == 0 ? 0 : all[samples / 2];
+	out->p99 = samples == 0 ? 0 : all[samples * 99 / 100];
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	out->peak_rss = usage.ru_maxrss;
+}
+
+int main(int argc, char *argv[])
+{
+	int threads = 4;
+	long calls = 200000;
+	int flags = MEM_THREAD_SAFE | MEM_GROWABLE;
+	size_t map_threshold = 128 * 1024;
+	size_t heap_size = HEAP_SIZE;
+	char *unit;
+	const char *only_workload = NULL, *only_allocator = NULL, *csv_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:f:m:s:w:a:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 't': threads = atoi(optarg); break;
+		case 'n': calls = atol(optarg); break;
+		case 'f': flags = atoi(optarg); break;
+		case 'm': map_threshold = strtoul(optarg, NULL, 0); break;
+		case 's':
+			heap_size = strtoul(optarg, &unit, 0);
+			heap_size <<= *unit == 'G' ? 30 : *unit == 'M' ? 20 : *unit == 'K' ? 10 : 0;
+			break;
+		case 'w': only_workload = optarg; break;
+		case 'a': only_allocator = optarg; break;
+		case 'o': csv_path = optarg; break;
+		default: threads = 0; break;
+		}
+	}
+	if (optind != argc || threads < 1 || calls < LARSON_ROUNDS || heap_size == 0)
+	{
+		fprintf(stderr, "Usage: %s [-t threads] [-n calls] [-f flags] [-m map_threshold] "
+			"[-s heap_size] [-w workload] [-a allocator] [-o file.csv]\n", argv[0]);
+		return 1;
+	}
+	if ((flags & MEM_THREAD_SAFE) == 0 && threads > 1)
+		fprintf(stderr, "bench: flags without MEM_THREAD_SAFE, libmem runs will race\n");
+
+	FILE *csv = NULL;
+	if (csv_path != NULL)
+	{
+		csv = fopen(csv_path, "w");
+		if (csv == NULL)
+		{
+			perror(csv_path);
+			return 1;
+		}
+		fprintf(csv, "workload,allocator,threads,calls,seconds,calls_per_sec,p50_ns,p99_ns,"
+			"peak_rss_kib,footprint_bytes,live_bytes,fragmentation,failed\n");
+	}
+
+	printf("%-9s %-7s %7s %12s %7s %7s %13s %13s %6s\n", "workload", "alloc", "threads",
+		"calls/s", "p50 ns", "p99 ns", "peak RSS KiB", "footprint KiB", "frag");
+	for (size_t l = 0; l < sizeof(workloads) / sizeof(workloads[0]); l++)
+	{
+		const workload *load = &workloads[l];
+		if (only_workload != NULL && strcmp(only_workload, load->name) != 0)
+			continue;
+
+		for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++)
+		{
+			if (only_allocator != NULL && strcmp(only_allocator, allocators[a].name) != 0)
+				continue;
+
+			//each run gets a fresh process, libmem can only be set up once
+			int fds[2];
+			result r;
+			if (pipe(fds) != 0)
+				return 1;
+			fflush(stdout);
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				mem = &allocators[a];
+				calls_per_thread = calls;
+				thread_count = threads;
+				if (mem->alloc == Alloc_Mem)
+				{
+					if (Init_Mem_Flags(heap_size, flags) != 0)
+						_exit(1);
+					Set_Mem_Map_Threshold(map_threshold);
+				}
+				Run(load, &r);
+				_exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+			}
+			close(fds[1]);
+			int status;
+			ssize_t got = read(fds[0], &r, sizeof(r));
+			close(fds[0]);
+			waitpid(pid, &status, 0);
+			if (got != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			{
+				printf("%-9s %-7s failed\n", load->name, allocators[a].name);
+				continue;
+			}
+
+			int count = load->paired ? (threads < 2 ? 2 : threads / 2 * 2) : threads;
+			double rate = r.seconds > 0 ? r.calls / r.seconds : 0;
+			double frag = r.live > 0 ? (double)r.footprint / r.live : 0;
+			printf("%-9s %-7s %7d %12.0f %7llu %7llu %13ld %13zu %6.2f", load->name,
+				allocators[a].name, count, rate, (unsigned long long)r.p50,
+				(unsigned long long)r.p99, r.peak_rss, r.footprint / 1024, frag);
+			if (r.failed != 0)
+				printf(" (%ld failed)", r.failed);
+			printf("\n");
+			if (csv != NULL)
+				fprintf(csv, "%s,%s,%d,%ld,%.6f,%.0f,%llu,%llu,%ld,%zu,%zu,%.4f,%ld\n",
+					load->name, allocators[a].name, count, r.calls, r.seconds, rate,
+					(unsigned long long)r.p50, (unsigned long long)r.p99, r.peak_rss,
+					r.footprint, r.live, frag, r.failed);
+		}
+	}
+
+	if (csv != NULL)
+		fclose(csv);
+	return 0;
+}
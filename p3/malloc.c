@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+// Main File:        mem.c - mem allocation and freeing
+// This File:        malloc.c
+// Other Files:      mem.h, mem.c
+// Semester:         CS 354 Spring 2019
+//
+// Author:           Bryce Van Camp
+// Email:            bvancamp@wisc.edu
+// CS Login:         bvan-camp
+//
+/////////////////////////// OTHER SOURCES OF HELP //////////////////////////////
+//                   fully acknowledge and credit all sources of help,
+//                   other than Instructors and TAs.
+//
+// Persons:          none
+//
+// Online sources:   none
+//////////////////////////// 80 columns wide ///////////////////////////////////
+
+/*
+ * Drop-in malloc family built on Alloc_Mem and Free_Mem, so any dynamically
+ * linked program can run on this allocator with
+ *   LD_PRELOAD=./libmalloc.so program
+ * The heap is set up on the first call, thread-safe and growable, with
+ * requests of MALLOC_MAP_THRESHOLD bytes and more mapped on their own.
+ * Pointers that don't belong to the heap (e.g. from the loader's own
+ * allocator before this library was bound) are ignored by free and refused
+ * by realloc, which can't tell how much of them to copy.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define MALLOC_HEAP_SIZE (1024 * 1024)
+#define MALLOC_FLAGS (MEM_THREAD_SAFE | MEM_GROWABLE)
+#define MALLOC_MAP_THRESHOLD (128 * 1024)
+
+/* malloc must return memory aligned for any type, which every payload is */
+#define MALLOC_ALIGNMENT MEM_ALIGNMENT
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int init_failed = 0;
+
+/*
+ * Function run once, on the first call into the malloc family.
+ */
+static void Init_Malloc()
+{
+	if (Init_Mem_Flags(MALLOC_HEAP_SIZE, MALLOC_FLAGS) != 0)
+		init_failed = 1;
+	else
+		Set_Mem_Map_Threshold(MALLOC_MAP_THRESHOLD);
+}
+
+/*
+ * Function for allocating size bytes aligned to alignment, the common part
+ * of every allocating entry point.
+ * Returns NULL and sets errno to ENOMEM on failure.
+ */
+static void* Alloc_Aligned(size_t size, size_t alignment)
+{
+	pthread_once(&init_once, Init_Malloc);
+
+	//the heap can't hand out zero bytes
+	if (size == 0) size = 1;
+	if (init_failed)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	void *ptr = alignment <= MALLOC_ALIGNMENT ? Alloc_Mem(size) : Alloc_Mem_Aligned(size, alignment);
+	if (ptr == NULL)
+		errno = ENOMEM;
+	return ptr;
+}
+
+void* malloc(size_t size)
+{
+	return Alloc_Aligned(size, MALLOC_ALIGNMENT);
+}
+
+void free(void *ptr)
+{
+	if (ptr != NULL)
+		Free_Mem(ptr);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	if (size != 0 && nmemb > SIZE_MAX / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	void *ptr = malloc(nmemb * size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+void* realloc(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return malloc(size);
+	if (size == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	//a pointer from elsewhere has an unknown size, so nothing can be copied
+	//out of it safely
+	if (Size_Mem(ptr) == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	void *new_ptr = Realloc_Mem(ptr, size);
+	if (new_ptr == NULL)
+		errno = ENOMEM;
+	return new_ptr;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	if (alignment == 0 || alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	void *ptr = Alloc_Aligned(size, alignment < MALLOC_ALIGNMENT ? MALLOC_ALIGNMENT : alignment);
+	if (ptr == NULL)
+		return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	return Alloc_Aligned(size, alignment < MALLOC_ALIGNMENT ? MALLOC_ALIGNMENT : alignment);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+void* valloc(size_t size)
+{
+	return Alloc_Aligned(size, getpagesize());
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+	return Size_Mem(ptr);
+}
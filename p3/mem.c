@@ -17,21 +17,29 @@
 // Online sources:   none
 //////////////////////////// 80 columns wide ///////////////////////////////////
 
+#define _GNU_SOURCE // mremap, MAP_HUGETLB
+
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #include "mem.h"
 
 #define A_BIT 1
 #define P_BIT 2
 #define PA_BITS 3
-#define ALL_BUT_PA_BITS 0xFFFFFFFC
-#define ALL_BUT_P_BIT 0xFFFFFFFD
-#define ALL_BUT_A_BIT 0xFFFFFFFE
+#define ALL_BUT_PA_BITS (~(size_t)PA_BITS)
+#define ALL_BUT_P_BIT (~(size_t)P_BIT)
+#define ALL_BUT_A_BIT (~(size_t)A_BIT)
 #define END_OF_HEAP ((BYTE*)start_block + heap_size)
 #define HEAP_REMAINING (heap_size - heap_used)
 
@@ -44,6 +52,82 @@
 #define IS_ALLOCD(block) (block->size_status & A_BIT)
 #define IS_PREV_ALLOCD(block) (block->size_status & P_BIT)
 
+#define ALIGNMENT MEM_ALIGNMENT
+#define MIN_BLOCK_SIZE (4 * sizeof(size_t))
+#define TINY_BLOCK_SIZE (2 * sizeof(size_t))
+#define IS_TINY(size) ((size) < MIN_BLOCK_SIZE)
+#define MIN_CLASS_SHIFT (sizeof(size_t) == 4 ? 4 : 5)
+#define NUM_CLASSES MEM_NUM_CLASSES
+
+#define TO_OFFSET(block) ((size_t)((BYTE*)(block) - heap_base))
+#define TO_BLOCK(offset) ((block_header*)(heap_base + (offset)))
+#define GET_LINKS(block) ((free_links*)((block_header*)(block) + 1))
+
+#define CACHE_MAX_BLOCK_SIZE 256
+#define CACHE_BINS (CACHE_MAX_BLOCK_SIZE / ALIGNMENT + 1)
+#define CACHE_BIN(size) ((size) / ALIGNMENT)
+#define CACHE_BATCH 16
+#define CACHE_LIMIT 64
+#define CACHE_KEY 0x7CAC4E
+#define GET_CACHE_ENTRY(block) ((cache_entry*)((block_header*)(block) + 1))
+
+#define GOOD_FIT_CANDIDATES 8
+
+#define QUICK_MAX_BLOCK_SIZE 512
+#define QUICK_BINS (QUICK_MAX_BLOCK_SIZE / ALIGNMENT + 1)
+#define QUICK_BIN(size) ((size) / ALIGNMENT)
+#define QUICK_LIMIT_SHIFT 2
+#define QUICK_KEY 0x901C4E
+
+#define SLAB_SIZE 4096
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT + 1)
+#define SLAB_CLASS(size) (((size) + ALIGNMENT - 1) / ALIGNMENT)
+#define SLAB_MAP_WORDS (SLAB_SIZE / ALIGNMENT / 32)
+#define SLAB_NONE 0xFFFF
+#define SLAB_OBJECTS(s) ((BYTE*)(s) + (sizeof(slab) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+#define GUARD_MIN_SIZE (16 * 1024)
+#define GUARD_FRAME(ptr) ((size_t)((BYTE*)(ptr) - heap_base) / guard_size)
+#define IS_GUARD_FRAME(frame) (guard_map[(frame) / 8] & (1 << (frame) % 8))
+
+#ifdef MEM_DEBUG
+#define CANARY_SIZE sizeof(size_t)
+#else
+#define CANARY_SIZE 0
+#endif
+#define CANARY_KEY ((size_t)0xCA4A41E5)
+#define CANARY_BYTE 0xCA
+#define GET_CANARY(block) ((size_t*)((BYTE*)(block) + GET_BLOCK_SIZE(block)) - 1)
+
+#define MAP_HEADER_SIZE sizeof(map_header)
+#define GET_MAP_HEADER(ptr) ((map_header*)((BYTE*)(ptr) - MAP_HEADER_SIZE))
+#define MAP_TABLE_BITS 17
+#define MAP_TABLE_SIZE ((size_t)1 << MAP_TABLE_BITS)
+#define MAP_MAX (MAP_TABLE_SIZE / 2)
+
+#define HANDLE_MAX (1 << 20)
+#define HANDLE_WORD(block) ((size_t*)((BYTE*)((block) + 1) + Usable_Size(block)) - 1)
+
+#define FILE_MAGIC "MEMHEAP"
+#define FILE_VERSION 1
+
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define MAX_NODES 1024
+
+#define GROW_MIN_SIZE (64 * 1024)
+#define TRIM_THRESHOLD (256 * 1024)
+#define RESERVE_SIZE (sizeof(size_t) == 4 ? (size_t)1 << 30 : (size_t)1 << 38)
+
+#define TREE_MIN_BLOCK_SIZE ((sizeof(tree_node) + 2 * sizeof(block_header) + \
+	ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+#define RED 0
+#define BLACK 1
+#define NODE(offset) ((tree_node*)(TO_BLOCK(offset) + 1))
+#define COLOR(offset) ((offset) == 0 ? BLACK : NODE(offset)->color)
+#define IN_TREE(block) (free_index == MEM_TREE_INDEX && \
+	GET_BLOCK_SIZE(block) >= TREE_MIN_BLOCK_SIZE)
+
 #define TRUE 1
 #define FALSE 0
 
@@ -56,9 +140,10 @@ typedef unsigned char BYTE;
  */
 typedef struct block_header
 {
-	int size_status;
+	size_t size_status;
 	/*
-	* Size of the block is always a multiple of 8.
+	* Size of the block is always a multiple of ALIGNMENT, i.e. 8 on 32-bit
+	* and 16 on 64-bit targets, so payloads are ALIGNMENT-aligned.
 	* Size is stored in all block headers and free block footers.
 	*
 	* Status is stored only in headers using the two least significant bits.
@@ -73,7 +158,7 @@ typedef struct block_header
 	* End Mark:
 	*  The end of the available memory is indicated using a size_status of 1.
 	*
-	* Examples:
+	* Examples (32-bit):
 	*
 	* 1. Allocated block of size 24 bytes:
 	*    Header:
@@ -89,24 +174,311 @@ typedef struct block_header
 	*/
 } block_header;
 
+/*
+ * This structure is stored in the payload of each free block, right after its
+ * header, and links the block into the free list of its size class.
+ * Links are offsets from heap_base rather than raw pointers so that a free
+ * block of MIN_BLOCK_SIZE (header + links + footer) fits them on any target.
+ * An offset of 0 marks the end of a list since no block starts at heap_base.
+ */
+typedef struct free_links
+{
+	size_t next;
+	size_t prev;
+} free_links;
+
+/*
+ * This structure takes the place of free_links in free blocks indexed by the
+ * size-ordered red-black tree (Init_Mem_Flags with MEM_TREE_INDEX).
+ * Nodes are keyed by block size, then by offset so that every key is unique
+ * and equal sizes are ordered by address. Links are offsets like free_links,
+ * so a node fits in any free block of at least TREE_MIN_BLOCK_SIZE bytes.
+ * Smaller free blocks stay on the free list of the first size class.
+ */
+typedef struct tree_node
+{
+	size_t left;
+	size_t right;
+	size_t parent;
+	int color;
+} tree_node;
+
 /* Global variable - DO NOT CHANGE. It should always point to the first block,
  * i.e., the block at the lowest address.
  */
 
 block_header *start_block = NULL;
-static int heap_size = 0;
-static int heap_used = 0;
+static BYTE *heap_base = NULL;
+static size_t heap_size = 0;
+static size_t heap_used = 0;
+
+/*
+ * Growable heap (Init_Mem_Flags with MEM_GROWABLE).
+ * RESERVE_SIZE bytes of address space are reserved up front and committed
+ * from the start as the heap grows, so the heap is always one contiguous range
+ * with a single end mark, and FIND_NEXT_BLOCK/FIND_PREV_BLOCK need no chunk
+ * boundaries. mapped_size is how much of it is readable and writable.
+ */
+static BOOL growable = FALSE;
+static size_t initial_size = 0;
+static size_t mapped_size = 0;
+static size_t reserved_size = 0;
+
+/*
+ * Segregated free lists, one per power-of-two size class.
+ * Class k holds the free blocks with size in [MIN_BLOCK_SIZE << k,
+ * MIN_BLOCK_SIZE << (k+1)); the last class also holds everything larger.
+ * Each entry is the offset of the first block in the list or 0 if the class
+ * has no free blocks. list_largest holds the size of the largest block in
+ * each list, 0 for an empty one, so Mem_Stats never searches them.
+ */
+static size_t free_lists[NUM_CLASSES];
+static size_t list_largest[NUM_CLASSES];
+
+/*
+ * Compact blocks (Init_Mem_Flags with MEM_COMPACT).
+ * Requests of up to one word get a TINY_BLOCK_SIZE block, a header and the
+ * word, instead of MIN_BLOCK_SIZE. Once freed such a block only has room for
+ * its header and footer, so it isn't indexed: it waits for a neighbor to be
+ * freed and coalesce with it. Tiny blocks bypass the thread caches and quick
+ * lists, which keep their links in the payload.
+ */
+static size_t min_alloc_size = MIN_BLOCK_SIZE;
+
+/* Free block index chosen at init time and the root of the tree index */
+static int free_index = MEM_LIST_INDEX;
+static size_t tree_root = 0;
+
+/*
+ * Placement policy chosen with Set_Mem_Policy. Next-fit resumes each free
+ * list at its rover, the offset of the block the last search of that class
+ * stopped at; in the tree it resumes after the key (rover_size, rover_offset).
+ */
+static int policy = MEM_BEST_FIT;
+static size_t good_fit_candidates = GOOD_FIT_CANDIDATES;
+static size_t good_fit_tolerance = 0;
+static size_t rovers[NUM_CLASSES];
+static size_t rover_size = 0;
+static size_t rover_offset = 0;
+
+/*
+ * Thread-safe mode (Init_Mem_Flags with MEM_THREAD_SAFE).
+ * heap_lock guards every block header and index above. Small blocks are
+ * cached per thread by exact block size: the payload of a cached block holds
+ * a cache_entry and the block stays marked allocated in the heap, so the
+ * common Alloc_Mem/Free_Mem pair only touches the calling thread's cache.
+ */
+typedef struct cache_entry
+{
+	size_t next; // offset of the next cached block in the bin, 0 if none
+	size_t key;  // CACHE_KEY while cached, to catch double frees cheaply
+} cache_entry;
+
+typedef struct cache_bin
+{
+	size_t head;
+	int count;
+} cache_bin;
+
+typedef struct cache
+{
+	cache_bin bins[CACHE_BINS];
+	BOOL registered; // whether the exit destructor is armed for this thread
+	//counts of cache hits, added to stats the next time the thread takes the lock
+	size_t allocs;
+	size_t frees;
+	size_t alloc_by_class[NUM_CLASSES];
+} cache;
+
+static BOOL thread_safe = FALSE;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_cache_key;
+static __thread cache thread_cache;
+
+/*
+ * Counters behind Mem_Stats, maintained as the heap changes. They are only
+ * touched with heap_lock held in thread-safe mode. heap_size, used_bytes and
+ * largest_free are filled in when Mem_Stats is called.
+ */
+static mem_stats stats;
+
+/*
+ * Slab front-end (Init_Mem_Flags with MEM_SLAB).
+ * Requests of up to SLAB_MAX_SIZE bytes are served from slabs: allocated
+ * blocks whose payload is one SLAB_SIZE aligned frame, starting with a slab
+ * header and followed by objects of one size class with no headers of their
+ * own. Objects come off a free stack threaded through the free objects, and
+ * past its end from the never used tail of the slab; the bitmap of live
+ * objects catches bad frees. slab_map has a bit per frame of the heap range
+ * telling Free_Mem which pointers belong to a slab.
+ */
+typedef struct slab
+{
+	size_t next;        // offset of the next slab of the class with free objects
+	size_t prev;
+	uint16_t size;      // object size, a multiple of ALIGNMENT
+	uint16_t capacity;  // objects that fit in the slab
+	uint16_t used;      // live objects
+	uint16_t fresh;     // objects handed out at least once, the rest are untouched
+	uint16_t free_top;  // index of the top of the free stack, SLAB_NONE if empty
+	uint32_t live[SLAB_MAP_WORDS];
+} slab;
+
+static BYTE *slab_map = NULL;
+static size_t slab_partial[SLAB_CLASSES];
+
+/*
+ * Deferred coalescing (Init_Mem_Flags with MEM_DEFERRED).
+ * Freed blocks of up to QUICK_MAX_BLOCK_SIZE bytes are pushed on a quick
+ * list by exact size instead of being coalesced, and stay marked allocated
+ * so that their neighbors don't merge with them either. Alloc_Block takes an
+ * exact size from its quick list without searching or splitting. The quick
+ * lists are coalesced all at once when a request doesn't fit otherwise or
+ * they hold more than heap_size >> QUICK_LIMIT_SHIFT bytes. A listed block
+ * keeps its next offset and QUICK_KEY in its free_links.
+ */
+static BOOL deferred = FALSE;
+static size_t quick_lists[QUICK_BINS];
+
+/*
+ * Guard pages (Init_Mem_Flags with MEM_GUARD).
+ * Requests of at least GUARD_MIN_SIZE bytes get a block whose payload ends
+ * right at an inaccessible page, so running past it faults at once. The
+ * guard page sits inside the block, followed by one last word that keeps the
+ * next block aligned. guard_map has a bit per page of the heap range telling
+ * which pages are guards.
+ *
+ * Debug builds (make debug, MEM_DEBUG) also end every allocated block with a
+ * canary: the last word holds the requested size xor CANARY_KEY and the
+ * padding between the payload and it is filled with CANARY_BYTE. Free_Mem,
+ * Realloc_Mem and Check_Mem refuse a block whose canary was overwritten.
+ *
+ * With the MEM_CHECK environment variable set to N, every Nth call of the
+ * public API runs Check_Mem and aborts if the heap is corrupt.
+ */
+static BYTE *guard_map = NULL;
+static size_t guard_size = 0;
+static size_t check_interval = 0;
+static size_t check_calls = 0;
+
+/*
+ * Mapped allocations (Set_Mem_Map_Threshold).
+ * Requests of at least map_threshold bytes bypass the heap: each gets its own
+ * anonymous mapping that starts with a map_header, is unmapped when freed and
+ * moved with mremap when resized, without copying. The headers of the live
+ * mappings are kept in map_table, a hash set with linear probing that is
+ * mapped outside the heap on first use. A pointer outside the heap is taken
+ * for a mapped payload only if its header is in the set, so nothing is read
+ * through a pointer that was never mapped or is no longer.
+ */
+typedef struct map_header
+{
+	size_t map_size; // bytes mapped, header included
+	size_t unused;   // keeps the payload ALIGNMENT aligned
+} map_header;
+
+static size_t map_threshold = 0;
+static map_header **map_table = NULL;
+static size_t map_count = 0;
+
+/*
+ * Page backing (Init_Mem_Flags with MEM_HUGE_PAGES or MEM_HUGETLB, and
+ * Set_Mem_Node). The heap's range starts on a HUGE_PAGE_SIZE boundary so the
+ * kernel can back all of it with transparent huge pages. Mappings of large
+ * requests are advised the same way and bound to mem_node like the heap.
+ */
+static BOOL huge_pages = FALSE;
+static size_t page_size = 0;
+static int mem_node = -1;
+
+/*
+ * Persistent heap (Init_Mem_File).
+ * The file starts with a page holding a file_header, followed by the heap's
+ * range. Block headers and footers hold sizes and free links hold offsets
+ * from heap_base, so the heap means the same wherever the file gets mapped.
+ * Only the roots of the free index live outside it, and those are rebuilt
+ * on attach by walking the blocks. The walk doubles as the consistency
+ * check.
+ */
+typedef struct file_header
+{
+	char magic[8];      // FILE_MAGIC
+	uint32_t version;   // FILE_VERSION
+	uint32_t word_size; // sizeof(size_t) of the program that made it
+	uint64_t heap_size; // heap_size of the heap, end mark excluded
+	uint64_t base;      // where it was last mapped, tried first next time
+	uint64_t root;      // offset of the payload set with Set_Mem_Root, 0 if none
+} file_header;
+
+static file_header *heap_file = NULL;
+
+/*
+ * Movable blocks (Handle_Alloc) and the compactor (Compact_Mem).
+ * A handle is an index into handle_table, plus 1 so that 0 is never valid.
+ * Its entry holds the offset of the block, which may change whenever the
+ * handle isn't locked, and the last word of the block's usable payload holds
+ * the handle, so the compactor can tell which blocks it may move. Free
+ * entries are chained through next_free. The table is mapped outside the
+ * heap on first use.
+ *
+ * Compact_Mem resumes at compact_cursor. Any block start before it that a
+ * free or merge may have made stale is no lower than compact_mark, the lowest
+ * block start changed since the last step, so a step starts at the lower of
+ * the two.
+ */
+typedef struct handle_entry
+{
+	size_t offset;      // offset of the block, 0 if the entry is free
+	uint32_t locks;     // Handle_Lock calls not yet undone
+	uint32_t next_free; // next free entry plus 1, 0 if none
+} handle_entry;
+
+static handle_entry *handle_table = NULL;
+static size_t handle_count = 0;
+static uint32_t handle_free = 0;
+static size_t compact_cursor = 0;
+static size_t compact_mark = SIZE_MAX;
+
+/*
+ * Trace recorder (Trace_Mem_Start or the MEM_TRACE_FILE environment variable).
+ * Every call of the public API is appended to trace_ring, a power-of-two
+ * sized ring mapped outside the heap. Slots are claimed with an atomic add on
+ * its next count, so recording takes no lock; once the ring is full the
+ * oldest records are overwritten. A call is recorded after it holds the
+ * block it returns and before it releases the block it was given, so the
+ * records of any one address are in the order the calls took effect.
+ * A recorder reads trace_ring once and only uses what it points to, so
+ * Trace_Mem_Start can put a new ring in its place. The old ring stays mapped
+ * since a recorder may still be writing to it.
+ */
+typedef struct trace_buffer
+{
+	size_t capacity;          // records the ring holds, a power of two
+	size_t next;              // records claimed since the recorder started
+	struct timespec start;    // when the recorder started
+	mem_trace_record records[];
+} trace_buffer;
+
+static trace_buffer *volatile trace_ring = NULL;
+static volatile BOOL tracing = FALSE;
+static char trace_path[4096];
+
+/* Init_Mem_Flags arguments, saved in trace headers so a replay can match them */
+static size_t init_region_size = 0;
+static int init_flags = 0;
 
 /*
  * This inline function sets the p-bit of the next block appropriately.
+ * The end mark's p-bit is kept up to date too, it tells whether the last
+ * block of the heap is free.
  *
  * cur_block this is the block header that is passed in
  */
 static inline void Set_Next_PBit(block_header *cur_block)
 {
 	block_header *next_block = FIND_NEXT_BLOCK(cur_block);
-	//ensure that next_block is inside the heap space
-	if (next_block < END_OF_HEAP)
+	//ensure that next_block is inside the heap space or the end mark
+	if ((BYTE*)next_block <= END_OF_HEAP)
 	{
 		//set p-bit to 1 if current block is alloc'd
 		if (IS_ALLOCD(cur_block)) next_block->size_status |= P_BIT;
@@ -116,219 +488,2982 @@ static inline void Set_Next_PBit(block_header *cur_block)
 }
 
 /*
- * Function for allocating 'size' bytes of heap memory.
- * Argument size: requested size for the payload
- * Returns address of allocated block on success.
- * Returns NULL on failure.
- * This function should:
- * - Check size - Return NULL if not positive or if larger than heap space.
- * - Determine block size rounding up to a multiple of 8 and possibly adding padding as a result.
- * - Use BEST-FIT PLACEMENT POLICY to find the block closest to the required block size
- * - Use SPLITTING to divide the chosen free block into two if it is too large.
- * - Update header(s) and footer as needed.
- * Tips: Be careful with pointer arithmetic.
+ * This inline function writes the footer of a free block, i.e. its size.
+ *
+ * block this is the header of the free block
  */
-void* Alloc_Mem(int size)
+static inline void Set_Footer(block_header *block)
 {
-	//init heap_size to store size of heap space
-	if (heap_size == 0) heap_size = GET_BLOCK_SIZE(start_block);
+	block_header *footer = (block_header*)((BYTE*)block + GET_BLOCK_SIZE(block)) - 1;
+	footer->size_status = GET_BLOCK_SIZE(block);
+}
 
-	//Check size: Return NULL if not positive.
-	if (size <= 0)
-		return NULL;
+/*
+ * This inline function returns the size class that a block size belongs to.
+ *
+ * size this is the block size, at least MIN_BLOCK_SIZE
+ */
+static inline int Get_Class(size_t size)
+{
+	int size_class = 0;
+	//shift out the bits below the smallest class, then count the remaining ones
+	for (size >>= MIN_CLASS_SHIFT + 1; size > 0 && size_class < NUM_CLASSES - 1; size >>= 1)
+		size_class++;
+	return size_class;
+}
+
+/*
+ * Function for adding a free block to the head of its class's free list.
+ *
+ * block this is the header of the free block, its size must already be set
+ */
+static void List_Insert(block_header *block)
+{
+	int size_class = Get_Class(GET_BLOCK_SIZE(block));
+	free_links *links = GET_LINKS(block);
 
-	//Determine block size rounding up to a multiple of 8 and possibly adding padding as a result.
-	int size_before_padding = sizeof(block_header) + size;
-	int pad_size = (size_before_padding % 8 == 0) ? 0 : 8 - (size_before_padding % 8);
-	int size_needed = size_before_padding + pad_size;
+	links->prev = 0;
+	links->next = free_lists[size_class];
+	//point the old head back at the new one
+	if (links->next != 0)
+		GET_LINKS(TO_BLOCK(links->next))->prev = TO_OFFSET(block);
+	free_lists[size_class] = TO_OFFSET(block);
 
-	//Check size_needed: Return NULL if larger than remaining heap space.
-	if (size_needed > HEAP_REMAINING)
-		return NULL;
+	if (GET_BLOCK_SIZE(block) > list_largest[size_class])
+		list_largest[size_class] = GET_BLOCK_SIZE(block);
+}
+
+/*
+ * Function for unlinking a free block from its class's free list.
+ *
+ * block this is the header of the free block
+ */
+static void List_Remove(block_header *block)
+{
+	int size_class = Get_Class(GET_BLOCK_SIZE(block));
+	free_links *links = GET_LINKS(block);
 
-	//Use BEST-FIT PLACEMENT POLICY to find the block closest to the required block size
-	block_header *best_fit_block = NULL;
-	for (block_header *cur_block = start_block; cur_block < END_OF_HEAP;
-		cur_block = FIND_NEXT_BLOCK(cur_block))
+	//a next-fit search resumes at the block after a removed rover
+	if (rovers[size_class] == TO_OFFSET(block))
+		rovers[size_class] = links->next;
+
+	if (links->prev != 0)
+		GET_LINKS(TO_BLOCK(links->prev))->next = links->next;
+	else
+		free_lists[size_class] = links->next;
+
+	if (links->next != 0)
+		GET_LINKS(TO_BLOCK(links->next))->prev = links->prev;
+
+	//only taking out the largest block changes the list's largest size, the
+	//search for the next one stops early at another block of the same size
+	size_t size = GET_BLOCK_SIZE(block);
+	if (size != list_largest[size_class])
+		return;
+	size_t largest = 0;
+	for (size_t offset = free_lists[size_class]; offset != 0 && largest != size;
+		offset = GET_LINKS(TO_BLOCK(offset))->next)
 	{
-		//if current block is alloc'd, go to next block in loop
-		if (IS_ALLOCD(cur_block)) continue;
+		if (GET_BLOCK_SIZE(TO_BLOCK(offset)) > largest)
+			largest = GET_BLOCK_SIZE(TO_BLOCK(offset));
+	}
+	list_largest[size_class] = largest;
+}
 
-		//if current block's size is exactly what was requested, 
-			//set best_fit_block to cur_block and break
-		if (GET_BLOCK_SIZE(cur_block) == size_needed)
+/*
+ * Function for finding the best-fit free block on the free lists.
+ * Only the free lists are searched, starting with the request's own class.
+ * All blocks in a higher class are larger than any block in a lower one, so
+ * the first class containing a large enough block holds the best fit.
+ * Good-fit bounds the search of that class: it takes the best of the first
+ * candidates fitting blocks, or the first block within tolerance bytes.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * candidates this is the most fitting blocks to compare, 0 for no limit
+ * tolerance this is the most bytes a block may exceed size_needed by to be
+ * taken without looking further, 0 for an exact match
+ * Returns the smallest free block of at least size_needed bytes, or NULL.
+ */
+static block_header* List_Find_Best_Fit(size_t size_needed, size_t candidates, size_t tolerance)
+{
+	for (int size_class = Get_Class(size_needed); size_class < NUM_CLASSES; size_class++)
+	{
+		block_header *best_fit_block = NULL;
+		size_t fits = 0;
+		for (size_t offset = free_lists[size_class]; offset != 0;
+			offset = GET_LINKS(TO_BLOCK(offset))->next)
 		{
-			best_fit_block = cur_block;
-			break;
+			block_header *cur_block = TO_BLOCK(offset);
+			stats.search_steps++;
+
+			if (GET_BLOCK_SIZE(cur_block) < size_needed)
+				continue;
+
+			//an exact match can't be beaten, so stop searching
+			if (GET_BLOCK_SIZE(cur_block) - size_needed <= tolerance)
+			{
+				if (tolerance != 0) stats.good_fit_close++;
+				return cur_block;
+			}
+
+			if (best_fit_block == NULL || GET_BLOCK_SIZE(cur_block) < GET_BLOCK_SIZE(best_fit_block))
+				best_fit_block = cur_block;
+
+			if (++fits == candidates)
+			{
+				stats.good_fit_limits++;
+				break;
+			}
 		}
 
-		//store the best fit block that we've found so far; first part checks if larger by 
-			//at least 8 bytes, second part checks if smaller than the current best-fit block
-		if ((GET_BLOCK_SIZE(cur_block) >= size_needed + 8) && (best_fit_block == NULL ? TRUE :
-			GET_BLOCK_SIZE(cur_block) < GET_BLOCK_SIZE(best_fit_block)))
+		if (best_fit_block != NULL)
+			return best_fit_block;
+	}
+
+	return NULL;
+}
+
+/*
+ * Function for finding the first fitting free block on the free lists,
+ * starting with the request's own class.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns a free block of at least size_needed bytes, or NULL.
+ */
+static block_header* List_Find_First_Fit(size_t size_needed)
+{
+	for (int size_class = Get_Class(size_needed); size_class < NUM_CLASSES; size_class++)
+	{
+		for (size_t offset = free_lists[size_class]; offset != 0;
+			offset = GET_LINKS(TO_BLOCK(offset))->next)
 		{
-			best_fit_block = cur_block;
+			stats.search_steps++;
+			if (GET_BLOCK_SIZE(TO_BLOCK(offset)) >= size_needed)
+				return TO_BLOCK(offset);
 		}
 	}
 
-	//return NULL if no block was found with a large enough size for the request
-	if (best_fit_block == NULL)
-		return NULL;
+	return NULL;
+}
 
-	//alloc without splitting if block is exactly the requested size
-	if (GET_BLOCK_SIZE(best_fit_block) == size_needed)
+/*
+ * Function for finding the next fitting free block on the free lists.
+ * Each class's list is searched from its rover around to the block before
+ * it, and the rover is left at the block found.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns a free block of at least size_needed bytes, or NULL.
+ */
+static block_header* List_Find_Next_Fit(size_t size_needed)
+{
+	for (int size_class = Get_Class(size_needed); size_class < NUM_CLASSES; size_class++)
 	{
-		//set a-bit of best_fit_block to 1
-		best_fit_block->size_status |= A_BIT;
-		//update p-bit of the next block to specify that best_fit_block is alloc'd
-		Set_Next_PBit(best_fit_block);
+		if (free_lists[size_class] == 0)
+			continue;
+
+		size_t start = rovers[size_class] != 0 ? rovers[size_class] : free_lists[size_class];
+		size_t offset = start;
+		do
+		{
+			stats.search_steps++;
+			if (GET_BLOCK_SIZE(TO_BLOCK(offset)) >= size_needed)
+			{
+				rovers[size_class] = offset;
+				return TO_BLOCK(offset);
+			}
+
+			//wrap around to the head at the end of the list
+			offset = GET_LINKS(TO_BLOCK(offset))->next;
+			if (offset == 0)
+			{
+				offset = free_lists[size_class];
+				if (start != offset) stats.next_fit_wraps++;
+			}
+		} while (offset != start);
 	}
-	//else use SPLITTING to divide the chosen free block into two if it is too large.
-	else if (GET_BLOCK_SIZE(best_fit_block) >= size_needed + 8)
-	{
-		//init new free block via splitting
-		block_header *new_free_block = (BYTE*)best_fit_block + size_needed;
 
-		//set header of new free block
-		new_free_block->size_status = GET_BLOCK_SIZE(best_fit_block) - size_needed;
-		new_free_block->size_status |= P_BIT;
+	return NULL;
+}
 
-		//set value of new free block's footer, i.e. size of block
-		*((BYTE*)new_free_block + GET_BLOCK_SIZE(new_free_block) - sizeof(int)) =
-			GET_BLOCK_SIZE(new_free_block);
+/*
+ * This inline function returns whether the node at offset a sorts before the
+ * node at offset b, comparing sizes first and addresses second.
+ */
+static inline BOOL Tree_Less(size_t a, size_t b)
+{
+	size_t size_a = GET_BLOCK_SIZE(TO_BLOCK(a));
+	size_t size_b = GET_BLOCK_SIZE(TO_BLOCK(b));
+	return size_a < size_b || (size_a == size_b && a < b);
+}
 
-		//update header of best_fit_block
-		best_fit_block->size_status = GET_PA_BITS(best_fit_block) + size_needed;
-		best_fit_block->size_status |= A_BIT;
-	}
-	//this else should never be entered but is a just-in-case measure
-	else return NULL;
+/*
+ * Function for replacing the subtree rooted at u with the one rooted at v.
+ * v may be 0, i.e. an empty subtree.
+ */
+static void Tree_Transplant(size_t u, size_t v)
+{
+	size_t parent = NODE(u)->parent;
 
-	//update amount of heap space used
-	heap_used += size_needed;
+	if (parent == 0) tree_root = v;
+	else if (u == NODE(parent)->left) NODE(parent)->left = v;
+	else NODE(parent)->right = v;
 
-	//return payload start addr of best fit block
-	return best_fit_block + 1;
+	if (v != 0) NODE(v)->parent = parent;
 }
 
 /*
- * Function for freeing up a previously allocated block.
- * Argument ptr: address of the block to be freed up.
- * Returns 0 on success.
- * Returns -1 on failure.
- * This function should:
- * - Return -1 if ptr is NULL.
- * - Return -1 if ptr is not a multiple of 8.
- * - Return -1 if ptr is outside of the heap space.
- * - Return -1 if ptr block is already freed.
- * - USE IMMEDIATE COALESCING if one or both of the adjacent neighbors are free.
- * - Update header(s) and footer as needed.
+ * Function for rotating the subtree rooted at x to the left, making x's right
+ * child the new root of the subtree.
  */
-int Free_Mem(void *ptr)
+static void Tree_Rotate_Left(size_t x)
 {
-	//Return -1 if ptr is NULL, is not a multiple of 8, or is outside the heap space.
-	if (ptr == NULL || (int)ptr % 8 != 0 || (ptr < start_block || ptr >= END_OF_HEAP))
-		return -1;
+	size_t y = NODE(x)->right;
 
-	//init cur_block to be the header of ptr
-	block_header *cur_block = (block_header*)ptr - 1;
+	NODE(x)->right = NODE(y)->left;
+	if (NODE(y)->left != 0) NODE(NODE(y)->left)->parent = x;
+	Tree_Transplant(x, y);
+	NODE(y)->left = x;
+	NODE(x)->parent = y;
+}
 
-	//Return -1 if the block is already freed.
-	if (!IS_ALLOCD(cur_block))
-		return -1;
+/*
+ * Function for rotating the subtree rooted at x to the right, making x's left
+ * child the new root of the subtree.
+ */
+static void Tree_Rotate_Right(size_t x)
+{
+	size_t y = NODE(x)->left;
 
-	//if alloc'd or outside of heap space, don't coalesce; else assign blocks to coalesce
-	block_header *prev_block = (IS_PREV_ALLOCD(cur_block) || FIND_PREV_BLOCK(cur_block)
-		< start_block) ? NULL : FIND_PREV_BLOCK(cur_block);
-	block_header *next_block = (IS_ALLOCD(FIND_NEXT_BLOCK(cur_block)) || FIND_NEXT_BLOCK(cur_block)
-		>= END_OF_HEAP) ? NULL : FIND_NEXT_BLOCK(cur_block);
+	NODE(x)->left = NODE(y)->right;
+	if (NODE(y)->right != 0) NODE(NODE(y)->right)->parent = x;
+	Tree_Transplant(x, y);
+	NODE(y)->right = x;
+	NODE(x)->parent = y;
+}
 
-	//USE IMMEDIATE COALESCING if one or both of the adjacent neighbors are free.
-	if (prev_block != NULL)
-	{
-		//coalesce prev_block and cur_block, update cur_block start addr
-		prev_block->size_status += GET_BLOCK_SIZE(cur_block);
-		cur_block = prev_block;
-	}
-	if (next_block != NULL)
+/*
+ * Function for adding a free block to the tree index in O(log n).
+ *
+ * block this is the header of the free block, its size must already be set
+ */
+static void Tree_Insert(block_header *block)
+{
+	size_t z = TO_OFFSET(block);
+	size_t parent = 0;
+
+	//walk down to the leaf position of the new key
+	for (size_t cur = tree_root; cur != 0;)
 	{
-		//coalesce cur_block and next_block
-		cur_block->size_status += GET_BLOCK_SIZE(next_block);
+		parent = cur;
+		cur = Tree_Less(z, cur) ? NODE(cur)->left : NODE(cur)->right;
 	}
 
-	//Update header(s) and footer as needed.
-
-	//set cur_block's a-bit to 0
-	cur_block->size_status &= ALL_BUT_A_BIT;
+	NODE(z)->left = 0;
+	NODE(z)->right = 0;
+	NODE(z)->parent = parent;
+	NODE(z)->color = RED;
 
-	//assign cur_block's footer and its value
-	int *cur_footer = (BYTE*)cur_block + GET_BLOCK_SIZE(cur_block) - sizeof(int);
-	*cur_footer = GET_BLOCK_SIZE(cur_block);
+	if (parent == 0) tree_root = z;
+	else if (Tree_Less(z, parent)) NODE(parent)->left = z;
+	else NODE(parent)->right = z;
 
-	//zero out p-bit of next block if it's within the heap space
-	Set_Next_PBit(cur_block);
+	//restore the red-black properties, z is red and may have a red parent
+	while (COLOR(NODE(z)->parent) == RED)
+	{
+		size_t zp = NODE(z)->parent;
+		size_t zpp = NODE(zp)->parent;
 
-	//update amount of heap space used
-	heap_used -= cur_block->size_status;
+		if (zp == NODE(zpp)->left)
+		{
+			size_t uncle = NODE(zpp)->right;
+			//red uncle: recolor and continue from the grandparent
+			if (COLOR(uncle) == RED)
+			{
+				NODE(zp)->color = BLACK;
+				NODE(uncle)->color = BLACK;
+				NODE(zpp)->color = RED;
+				z = zpp;
+				continue;
+			}
+			//black uncle: rotate z into the outside position, then rotate zpp
+			if (z == NODE(zp)->right)
+			{
+				z = zp;
+				Tree_Rotate_Left(z);
+				zp = NODE(z)->parent;
+			}
+			NODE(zp)->color = BLACK;
+			NODE(zpp)->color = RED;
+			Tree_Rotate_Right(zpp);
+		}
+		else
+		{
+			size_t uncle = NODE(zpp)->left;
+			if (COLOR(uncle) == RED)
+			{
+				NODE(zp)->color = BLACK;
+				NODE(uncle)->color = BLACK;
+				NODE(zpp)->color = RED;
+				z = zpp;
+				continue;
+			}
+			if (z == NODE(zp)->left)
+			{
+				z = zp;
+				Tree_Rotate_Right(z);
+				zp = NODE(z)->parent;
+			}
+			NODE(zp)->color = BLACK;
+			NODE(zpp)->color = RED;
+			Tree_Rotate_Left(zpp);
+		}
+	}
 
-	//Returns 0 on success.
-	return 0;
+	NODE(tree_root)->color = BLACK;
 }
 
 /*
- * Function used to initialize the memory allocator.
- * Intended to be called ONLY once by a program.
- * Argument sizeOfRegion: the size of the heap space to be allocated.
- * Returns 0 on success.
- * Returns -1 on failure.
+ * Function for removing a free block from the tree index in O(log n).
+ *
+ * block this is the header of the free block
  */
-int Init_Mem(int sizeOfRegion) {
-	int pagesize;
-	int padsize;
-	int fd;
-	int alloc_size;
-	void* space_ptr;
-	block_header* end_mark;
-	static int allocated_once = 0;
+static void Tree_Remove(block_header *block)
+{
+	size_t z = TO_OFFSET(block);
+	size_t y = z;
+	int y_color = NODE(y)->color;
+	size_t x;
+	size_t x_parent;
 
-	if (0 != allocated_once) {
-		fprintf(stderr,
-			"Error:mem.c: Init_Mem has allocated space during a previous call\n");
-		return -1;
+	if (NODE(z)->left == 0)
+	{
+		x = NODE(z)->right;
+		x_parent = NODE(z)->parent;
+		Tree_Transplant(z, x);
 	}
-	if (sizeOfRegion <= 0) {
-		fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
-		return -1;
+	else if (NODE(z)->right == 0)
+	{
+		x = NODE(z)->left;
+		x_parent = NODE(z)->parent;
+		Tree_Transplant(z, x);
 	}
+	else
+	{
+		//z has two children, splice out its successor y and put it in z's place
+		for (y = NODE(z)->right; NODE(y)->left != 0; y = NODE(y)->left)
+			;
+		y_color = NODE(y)->color;
+		x = NODE(y)->right;
 
-	// Get the pagesize
-	pagesize = getpagesize();
-
-	// Calculate padsize as the padding required to round up sizeOfRegion 
-	// to a multiple of pagesize
-	padsize = sizeOfRegion % pagesize;
+		if (NODE(y)->parent == z)
+		{
+			x_parent = y;
+		}
+		else
+		{
+			x_parent = NODE(y)->parent;
+			Tree_Transplant(y, x);
+			NODE(y)->right = NODE(z)->right;
+			NODE(NODE(y)->right)->parent = y;
+		}
+
+		Tree_Transplant(z, y);
+		NODE(y)->left = NODE(z)->left;
+		NODE(NODE(y)->left)->parent = y;
+		NODE(y)->color = NODE(z)->color;
+	}
+
+	//removing a black node leaves x's side one black short, fix it up
+	if (y_color == RED)
+		return;
+
+	while (x != tree_root && COLOR(x) == BLACK)
+	{
+		if (x == NODE(x_parent)->left)
+		{
+			size_t w = NODE(x_parent)->right;
+			if (COLOR(w) == RED)
+			{
+				NODE(w)->color = BLACK;
+				NODE(x_parent)->color = RED;
+				Tree_Rotate_Left(x_parent);
+				w = NODE(x_parent)->right;
+			}
+			if (COLOR(NODE(w)->left) == BLACK && COLOR(NODE(w)->right) == BLACK)
+			{
+				NODE(w)->color = RED;
+				x = x_parent;
+				x_parent = NODE(x)->parent;
+				continue;
+			}
+			if (COLOR(NODE(w)->right) == BLACK)
+			{
+				NODE(NODE(w)->left)->color = BLACK;
+				NODE(w)->color = RED;
+				Tree_Rotate_Right(w);
+				w = NODE(x_parent)->right;
+			}
+			NODE(w)->color = NODE(x_parent)->color;
+			NODE(x_parent)->color = BLACK;
+			NODE(NODE(w)->right)->color = BLACK;
+			Tree_Rotate_Left(x_parent);
+		}
+		else
+		{
+			size_t w = NODE(x_parent)->left;
+			if (COLOR(w) == RED)
+			{
+				NODE(w)->color = BLACK;
+				NODE(x_parent)->color = RED;
+				Tree_Rotate_Right(x_parent);
+				w = NODE(x_parent)->left;
+			}
+			if (COLOR(NODE(w)->left) == BLACK && COLOR(NODE(w)->right) == BLACK)
+			{
+				NODE(w)->color = RED;
+				x = x_parent;
+				x_parent = NODE(x)->parent;
+				continue;
+			}
+			if (COLOR(NODE(w)->left) == BLACK)
+			{
+				NODE(NODE(w)->right)->color = BLACK;
+				NODE(w)->color = RED;
+				Tree_Rotate_Left(w);
+				w = NODE(x_parent)->left;
+			}
+			NODE(w)->color = NODE(x_parent)->color;
+			NODE(x_parent)->color = BLACK;
+			NODE(NODE(w)->left)->color = BLACK;
+			Tree_Rotate_Right(x_parent);
+		}
+		x = tree_root;
+	}
+
+	if (x != 0) NODE(x)->color = BLACK;
+}
+
+/*
+ * Function for finding the best-fit free block in the tree index in O(log n).
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns the smallest, then lowest addressed, free block of at least
+ * size_needed bytes, or NULL.
+ */
+static block_header* Tree_Find_Best_Fit(size_t size_needed)
+{
+	size_t best_fit = 0;
+
+	for (size_t cur = tree_root; cur != 0;)
+	{
+		stats.search_steps++;
+		//every node to the left is smaller, so go left while cur still fits
+		if (GET_BLOCK_SIZE(TO_BLOCK(cur)) >= size_needed)
+		{
+			best_fit = cur;
+			cur = NODE(cur)->left;
+		}
+		else cur = NODE(cur)->right;
+	}
+
+	return best_fit == 0 ? NULL : TO_BLOCK(best_fit);
+}
+
+/*
+ * Function for finding the first fitting free block on the way down the
+ * tree index, which is the node nearest the root that fits.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns a free block of at least size_needed bytes, or NULL.
+ */
+static block_header* Tree_Find_First_Fit(size_t size_needed)
+{
+	for (size_t cur = tree_root; cur != 0; cur = NODE(cur)->right)
+	{
+		stats.search_steps++;
+		if (GET_BLOCK_SIZE(TO_BLOCK(cur)) >= size_needed)
+			return TO_BLOCK(cur);
+	}
+
+	return NULL;
+}
+
+/*
+ * Function for finding the next fitting free block in the tree index, the
+ * smallest key after the rover that fits, wrapping around to the best fit.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns a free block of at least size_needed bytes, or NULL.
+ */
+static block_header* Tree_Find_Next_Fit(size_t size_needed)
+{
+	size_t next_fit = 0;
+
+	for (size_t cur = tree_root; cur != 0;)
+	{
+		size_t size = GET_BLOCK_SIZE(TO_BLOCK(cur));
+		stats.search_steps++;
+
+		//both tests only ever go from false to true along the key order
+		if (size >= size_needed &&
+			(size > rover_size || (size == rover_size && cur > rover_offset)))
+		{
+			next_fit = cur;
+			cur = NODE(cur)->left;
+		}
+		else cur = NODE(cur)->right;
+	}
+
+	if (next_fit == 0)
+	{
+		block_header *block = Tree_Find_Best_Fit(size_needed);
+		if (block == NULL)
+			return NULL;
+		stats.next_fit_wraps++;
+		next_fit = TO_OFFSET(block);
+	}
+
+	rover_size = GET_BLOCK_SIZE(TO_BLOCK(next_fit));
+	rover_offset = next_fit;
+	return TO_BLOCK(next_fit);
+}
+
+/*
+ * Function for adding a free block to the free block index.
+ * Must be called after the block's size and footer are final.
+ *
+ * block this is the header of the free block
+ */
+static void Insert_Free_Block(block_header *block)
+{
+	stats.free_blocks++;
+	stats.free_bytes += GET_BLOCK_SIZE(block);
+	stats.free_by_class[Get_Class(GET_BLOCK_SIZE(block))]++;
+
+	//a tiny block has no room for links, only coalescing finds it again
+	if (IS_TINY(GET_BLOCK_SIZE(block)))
+		return;
+	if (IN_TREE(block)) Tree_Insert(block);
+	else List_Insert(block);
+}
+
+/*
+ * Function for removing a free block from the free block index.
+ * Must be called before the block's size changes or it becomes allocated.
+ *
+ * block this is the header of the free block
+ */
+static void Remove_Free_Block(block_header *block)
+{
+	stats.free_blocks--;
+	stats.free_bytes -= GET_BLOCK_SIZE(block);
+	stats.free_by_class[Get_Class(GET_BLOCK_SIZE(block))]--;
+
+	if (IS_TINY(GET_BLOCK_SIZE(block)))
+		return;
+	if (IN_TREE(block)) Tree_Remove(block);
+	else List_Remove(block);
+}
+
+/*
+ * Function for finding a free block for a request using the free block
+ * index chosen at init time and the current placement policy.
+ * Good-fit in the tree is plain best-fit, which is already O(log n) there.
+ *
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns a free block of at least size_needed bytes, or NULL.
+ */
+static block_header* Find_Fit(size_t size_needed)
+{
+	block_header *block;
+	stats.searches++;
+
+	if (free_index != MEM_TREE_INDEX)
+	{
+		switch (policy)
+		{
+		case MEM_FIRST_FIT: block = List_Find_First_Fit(size_needed); break;
+		case MEM_NEXT_FIT: block = List_Find_Next_Fit(size_needed); break;
+		case MEM_GOOD_FIT:
+			block = List_Find_Best_Fit(size_needed, good_fit_candidates, good_fit_tolerance);
+			break;
+		default: block = List_Find_Best_Fit(size_needed, 0, 0); break;
+		}
+	}
+	//blocks too small for a tree node only ever sit on the first class's list
+	else if (size_needed < TREE_MIN_BLOCK_SIZE && free_lists[0] != 0)
+	{
+		block = TO_BLOCK(free_lists[0]);
+	}
+	else
+	{
+		switch (policy)
+		{
+		case MEM_FIRST_FIT: block = Tree_Find_First_Fit(size_needed); break;
+		case MEM_NEXT_FIT: block = Tree_Find_Next_Fit(size_needed); break;
+		default: block = Tree_Find_Best_Fit(size_needed); break;
+		}
+	}
+
+	if (block == NULL)
+		stats.search_misses++;
+	return block;
+}
+
+/*
+ * This inline function returns the block size needed for a payload of size
+ * bytes: header plus payload, rounded up to a multiple of ALIGNMENT and to at
+ * least MIN_BLOCK_SIZE so the block has room for its links and footer once
+ * freed, or TINY_BLOCK_SIZE for compact blocks. Debug builds add a word for
+ * the canary. size must not be larger than the heap.
+ */
+static inline size_t Get_Size_Needed(size_t size)
+{
+	size_t size_before_padding = sizeof(block_header) + size + CANARY_SIZE;
+	size_t pad_size = (size_before_padding % ALIGNMENT == 0) ? 0 :
+		ALIGNMENT - (size_before_padding % ALIGNMENT);
+	size_t size_needed = size_before_padding + pad_size;
+
+	return size_needed < min_alloc_size ? min_alloc_size : size_needed;
+}
+
+/*
+ * This inline function tells whether an allocated block ends at a guard page.
+ * The page would start a word plus a page before the end of the block.
+ */
+static inline BOOL Is_Guarded(block_header *block)
+{
+	if (guard_map == NULL || GET_BLOCK_SIZE(block) < GUARD_MIN_SIZE)
+		return FALSE;
+
+	BYTE *guard = (BYTE*)block + GET_BLOCK_SIZE(block) - sizeof(size_t) - guard_size;
+	return (guard - heap_base) % guard_size == 0 && IS_GUARD_FRAME(GUARD_FRAME(guard));
+}
+
+/*
+ * This inline function returns the payload bytes of an allocated block that
+ * may be used, leaving out its canary and guard page.
+ */
+static inline size_t Usable_Size(block_header *block)
+{
+	size_t usable = GET_BLOCK_SIZE(block) - sizeof(block_header);
+	if (Is_Guarded(block))
+		return usable - guard_size - sizeof(size_t);
+	return usable - CANARY_SIZE;
+}
+
+/*
+ * This inline function arms the canary of an allocated block in debug builds
+ * and does nothing otherwise.
+ *
+ * block this is the header of an allocated block
+ * size this is the requested size, at most Usable_Size(block)
+ */
+static inline void Set_Canary(block_header *block, size_t size)
+{
+#ifdef MEM_DEBUG
+	memset((BYTE*)(block + 1) + size, CANARY_BYTE, Usable_Size(block) - size);
+	*GET_CANARY(block) = CANARY_KEY ^ size;
+#endif
+}
+
+/*
+ * Function for checking the canary of an allocated block in debug builds.
+ *
+ * block this is the header of an allocated block
+ * Returns FALSE if the canary or the padding before it was overwritten,
+ * always TRUE in other builds.
+ */
+static BOOL Check_Canary(block_header *block)
+{
+#ifdef MEM_DEBUG
+	size_t size = *GET_CANARY(block) ^ CANARY_KEY;
+	size_t usable = Usable_Size(block);
+	if (size > usable)
+		return FALSE;
+
+	BYTE *payload = (BYTE*)(block + 1);
+	for (BYTE *pad = payload + size; pad < payload + usable; pad++)
+		if (*pad != CANARY_BYTE)
+			return FALSE;
+#endif
+	return TRUE;
+}
+
+/*
+ * Function for giving the tail of a growable heap back to the OS once the last
+ * free block spans more than TRIM_THRESHOLD bytes of whole pages. The pages
+ * are dropped with MADV_DONTNEED and made inaccessible again but stay
+ * reserved, so the heap stays one contiguous range and can grow back.
+ *
+ * last_block this is the free block at the end of the heap, not yet indexed
+ */
+static void Trim_Heap(block_header *last_block)
+{
+	size_t pagesize = getpagesize();
+
+	//keep at least the initial region and a minimum free block before the end mark
+	size_t new_mapped = TO_OFFSET(last_block) + MIN_BLOCK_SIZE + sizeof(block_header);
+	new_mapped = (new_mapped + pagesize - 1) / pagesize * pagesize;
+	if (new_mapped < initial_size) new_mapped = initial_size;
+
+	if (mapped_size - new_mapped < TRIM_THRESHOLD)
+		return;
+
+	madvise(heap_base + new_mapped, mapped_size - new_mapped, MADV_DONTNEED);
+	mprotect(heap_base + new_mapped, mapped_size - new_mapped, PROT_NONE);
+	heap_size -= mapped_size - new_mapped;
+	mapped_size = new_mapped;
+
+	//shrink the last block up to the new end mark
+	last_block->size_status = GET_PA_BITS(last_block) + (size_t)(END_OF_HEAP - (BYTE*)last_block);
+	Set_Footer(last_block);
+	((block_header*)END_OF_HEAP)->size_status = A_BIT;
+}
+
+/*
+ * Function for returning an allocated block to the heap, coalescing it with
+ * its free neighbors. The caller must hold heap_lock in thread-safe mode.
+ *
+ * cur_block this is the header of a block that is currently allocated
+ */
+static void Free_Block(block_header *cur_block)
+{
+	//update amount of heap space used
+	heap_used -= GET_BLOCK_SIZE(cur_block);
+
+	//if alloc'd or outside of heap space, don't coalesce; else assign blocks to coalesce
+	block_header *prev_block = (IS_PREV_ALLOCD(cur_block) || FIND_PREV_BLOCK(cur_block)
+		< start_block) ? NULL : FIND_PREV_BLOCK(cur_block);
+	block_header *next_block = (IS_ALLOCD(FIND_NEXT_BLOCK(cur_block))
+		|| (BYTE*)FIND_NEXT_BLOCK(cur_block) >= END_OF_HEAP)
+		? NULL : FIND_NEXT_BLOCK(cur_block);
+
+	//USE IMMEDIATE COALESCING if one or both of the adjacent neighbors are free.
+	//neighbors are unlinked first since their sizes and classes are about to change
+	if (prev_block != NULL)
+	{
+		//coalesce prev_block and cur_block, update cur_block start addr
+		Remove_Free_Block(prev_block);
+		prev_block->size_status += GET_BLOCK_SIZE(cur_block);
+		cur_block = prev_block;
+		stats.coalesces++;
+	}
+	if (next_block != NULL)
+	{
+		//coalesce cur_block and next_block
+		Remove_Free_Block(next_block);
+		cur_block->size_status += GET_BLOCK_SIZE(next_block);
+		stats.coalesces++;
+	}
+
+	//Update header(s) and footer as needed.
+
+	//set cur_block's a-bit to 0
+	cur_block->size_status &= ALL_BUT_A_BIT;
+
+	//assign cur_block's footer and its value
+	Set_Footer(cur_block);
+
+	//zero out p-bit of next block if it's within the heap space
+	Set_Next_PBit(cur_block);
+	if (TO_OFFSET(cur_block) < compact_mark) compact_mark = TO_OFFSET(cur_block);
+
+	//give a large free tail of a growable heap back to the OS
+	if (growable && FIND_NEXT_BLOCK(cur_block) == (block_header*)END_OF_HEAP)
+		Trim_Heap(cur_block);
+
+	//put the coalesced block on the free list of its class
+	Insert_Free_Block(cur_block);
+}
+
+/*
+ * Function for growing a growable heap by committing more of its reserved
+ * address range. The old end mark becomes the header of a new free block,
+ * which is coalesced with the last block if that one is free.
+ *
+ * size_needed this is the size of the block that didn't fit
+ * Returns the free block at the end of the heap, at least size_needed bytes,
+ * or NULL if the reservation is used up.
+ */
+static block_header* Grow_Heap(size_t size_needed)
+{
+	block_header *new_block = (block_header*)END_OF_HEAP;
+	size_t pagesize = getpagesize();
+
+	//a free last block already covers part of the request
+	size_t last_free = IS_PREV_ALLOCD(new_block) ? 0 : (new_block - 1)->size_status;
+	size_t missing = size_needed > last_free ? size_needed - last_free : 0;
+	size_t grow_size = missing < GROW_MIN_SIZE ? GROW_MIN_SIZE : missing;
+	grow_size = (grow_size + pagesize - 1) / pagesize * pagesize;
+
+	if (grow_size > reserved_size - mapped_size)
+		grow_size = reserved_size - mapped_size;
+	if (grow_size < missing || grow_size == 0)
+		return NULL;
+	if (mprotect(heap_base + mapped_size, grow_size, PROT_READ | PROT_WRITE) != 0)
+		return NULL;
+
+	mapped_size += grow_size;
+	heap_size += grow_size;
+
+	//the old end mark becomes the header of the new space
+	new_block->size_status = GET_PA_BITS(new_block) & P_BIT;
+	new_block->size_status += grow_size;
+
+	//coalesce with the last block if it is free
+	if (!IS_PREV_ALLOCD(new_block))
+	{
+		block_header *prev_block = FIND_PREV_BLOCK(new_block);
+		Remove_Free_Block(prev_block);
+		prev_block->size_status += grow_size;
+		new_block = prev_block;
+		stats.coalesces++;
+	}
+
+	Set_Footer(new_block);
+	Insert_Free_Block(new_block);
+	if (TO_OFFSET(new_block) < compact_mark) compact_mark = TO_OFFSET(new_block);
+
+	//new end mark, the block before it is free
+	((block_header*)END_OF_HEAP)->size_status = A_BIT;
+
+	return new_block;
+}
+
+/*
+ * Function for coalescing every block on the quick lists, the lazy half of
+ * deferred coalescing.
+ * The caller must hold heap_lock in thread-safe mode.
+ */
+static void Consolidate_Quick_Lists()
+{
+	for (int i = 0; i < QUICK_BINS; i++)
+	{
+		while (quick_lists[i] != 0)
+		{
+			block_header *block = TO_BLOCK(quick_lists[i]);
+			quick_lists[i] = GET_LINKS(block)->next;
+			GET_LINKS(block)->prev = 0;
+			Free_Block(block);
+		}
+	}
+
+	stats.quick_blocks = 0;
+	stats.quick_bytes = 0;
+	stats.consolidations++;
+}
+
+/*
+ * Function for putting a freed block on its quick list without coalescing.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * block this is the header of an allocated block of at most
+ * QUICK_MAX_BLOCK_SIZE bytes
+ */
+static void Quick_Push(block_header *block)
+{
+	size_t *head = &quick_lists[QUICK_BIN(GET_BLOCK_SIZE(block))];
+	GET_LINKS(block)->next = *head;
+	GET_LINKS(block)->prev = QUICK_KEY;
+	*head = TO_OFFSET(block);
+	//the links may lie in the canary padding, which covers nothing now
+	Set_Canary(block, Usable_Size(block));
+
+	stats.quick_frees++;
+	stats.quick_blocks++;
+	stats.quick_bytes += GET_BLOCK_SIZE(block);
+	if (stats.quick_bytes > heap_size >> QUICK_LIMIT_SHIFT)
+		Consolidate_Quick_Lists();
+}
+
+/*
+ * Function for allocating a block of exactly size_needed bytes from the heap.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * size_needed this is the block size, as returned by Get_Size_Needed
+ * Returns the header of the allocated block, or NULL if nothing fits.
+ */
+static block_header* Alloc_Block(size_t size_needed)
+{
+	//a quick list of the exact size needs no search and no split
+	if (deferred && size_needed <= QUICK_MAX_BLOCK_SIZE && quick_lists[QUICK_BIN(size_needed)] != 0)
+	{
+		block_header *block = TO_BLOCK(quick_lists[QUICK_BIN(size_needed)]);
+		quick_lists[QUICK_BIN(size_needed)] = GET_LINKS(block)->next;
+		GET_LINKS(block)->prev = 0;
+		stats.quick_hits++;
+		stats.quick_blocks--;
+		stats.quick_bytes -= size_needed;
+		return block;
+	}
+
+	//Check size_needed: Return NULL if larger than remaining heap space.
+	//Blocks on the quick lists count as used until they are coalesced.
+	if (size_needed > HEAP_REMAINING + stats.quick_bytes && !growable)
+		return NULL;
+
+	//Use the PLACEMENT POLICY (best-fit by default) to find a large enough block
+	block_header *best_fit_block = Find_Fit(size_needed);
+
+	//nothing fits, coalesce the quick lists and look again
+	if (best_fit_block == NULL && stats.quick_blocks != 0)
+	{
+		Consolidate_Quick_Lists();
+		best_fit_block = Find_Fit(size_needed);
+	}
+
+	//a growable heap maps more space before giving up
+	if (best_fit_block == NULL && growable)
+		best_fit_block = Grow_Heap(size_needed);
+
+	//return NULL if no block was found with a large enough size for the request
+	if (best_fit_block == NULL)
+		return NULL;
+
+	//the block is no longer free, take it off its list
+	Remove_Free_Block(best_fit_block);
+
+	//use SPLITTING to divide the chosen free block into two if the rest can stand alone
+	if (GET_BLOCK_SIZE(best_fit_block) - size_needed >= MIN_BLOCK_SIZE)
+	{
+		//init new free block via splitting
+		block_header *new_free_block = (block_header*)((BYTE*)best_fit_block + size_needed);
+
+		//set header of new free block
+		new_free_block->size_status = GET_BLOCK_SIZE(best_fit_block) - size_needed;
+		new_free_block->size_status |= P_BIT;
+
+		//set value of new free block's footer, i.e. size of block
+		Set_Footer(new_free_block);
+		Insert_Free_Block(new_free_block);
+		stats.splits++;
+
+		//update header of best_fit_block
+		best_fit_block->size_status = GET_PA_BITS(best_fit_block) + size_needed;
+		best_fit_block->size_status |= A_BIT;
+	}
+	//else alloc the whole block, the leftover is too small to be a free block
+	else
+	{
+		//set a-bit of best_fit_block to 1
+		best_fit_block->size_status |= A_BIT;
+		//update p-bit of the next block to specify that best_fit_block is alloc'd
+		Set_Next_PBit(best_fit_block);
+	}
+
+	//update amount of heap space used
+	heap_used += GET_BLOCK_SIZE(best_fit_block);
+
+	Set_Canary(best_fit_block, Usable_Size(best_fit_block));
+	return best_fit_block;
+}
+
+/*
+ * Function for splitting the unused tail off an allocated block and freeing
+ * it, so the block keeps only size_needed bytes. Nothing is split off if the
+ * tail would be smaller than MIN_BLOCK_SIZE.
+ *
+ * block this is the header of an allocated block
+ * size_needed this is the block size to keep, a multiple of ALIGNMENT
+ */
+static void Split_Block(block_header *block, size_t size_needed)
+{
+	if (GET_BLOCK_SIZE(block) < size_needed + MIN_BLOCK_SIZE)
+		return;
+	size_t tail_size = GET_BLOCK_SIZE(block) - size_needed;
+
+	//carve the tail off as an allocated block, then free it to coalesce
+	block_header *tail = (block_header*)((BYTE*)block + size_needed);
+	tail->size_status = tail_size | P_BIT | A_BIT;
+	block->size_status = GET_PA_BITS(block) + size_needed;
+	stats.splits++;
+	Free_Block(tail);
+}
+
+/*
+ * Function for allocating a block whose payload is aligned to alignment.
+ * Over-allocates by alignment plus a minimum block, then frees the space in
+ * front of the aligned payload and the space after it.
+ *
+ * size_needed this is the block size, as returned by Get_Size_Needed
+ * alignment this is a power of two, larger than ALIGNMENT
+ * Returns the header of the allocated block, or NULL if nothing fits.
+ */
+static block_header* Alloc_Aligned_Block(size_t size_needed, size_t alignment)
+{
+	block_header *block = Alloc_Block(size_needed + alignment + MIN_BLOCK_SIZE);
+	if (block == NULL)
+		return NULL;
+
+	BYTE *payload = (BYTE*)(block + 1);
+	BYTE *aligned = (BYTE*)(((uintptr_t)payload + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+	if (aligned != payload)
+	{
+		//the space in front must be able to stand alone as a free block
+		while (aligned - payload < MIN_BLOCK_SIZE)
+			aligned += alignment;
+
+		size_t lead_size = aligned - payload;
+		block_header *aligned_block = (block_header*)aligned - 1;
+		aligned_block->size_status = (GET_BLOCK_SIZE(block) - lead_size) | P_BIT | A_BIT;
+		block->size_status = GET_PA_BITS(block) + lead_size;
+		Free_Block(block);
+		block = aligned_block;
+	}
+
+	Split_Block(block, size_needed);
+	Set_Canary(block, Usable_Size(block));
+	return block;
+}
+
+/*
+ * Function for allocating a block whose payload ends at a guard page.
+ * Like Alloc_Aligned_Block it over-allocates, here by a page plus two minimum
+ * blocks so that the space after the block can always be split off, and
+ * frees the space in front of the block and after it.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * size this is the requested size, at least GUARD_MIN_SIZE
+ * Returns the header of the allocated block, or NULL if nothing fits.
+ */
+static block_header* Alloc_Guarded_Block(size_t size)
+{
+	size_t payload_size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	//header and last word make up ALIGNMENT, so the block ends aligned
+	size_t size_needed = payload_size + guard_size + ALIGNMENT;
+	block_header *block = Alloc_Block(size_needed + guard_size + 2 * MIN_BLOCK_SIZE);
+	if (block == NULL)
+		return NULL;
+
+	BYTE *payload = (BYTE*)(block + 1);
+	BYTE *guard = (BYTE*)(((uintptr_t)payload + payload_size + guard_size - 1) &
+		~(uintptr_t)(guard_size - 1));
+
+	if (guard - payload_size != payload)
+	{
+		//the space in front must be able to stand alone as a free block
+		while (guard - payload_size - payload < MIN_BLOCK_SIZE)
+			guard += guard_size;
+
+		size_t lead_size = guard - payload_size - payload;
+		block_header *guarded_block = (block_header*)(guard - payload_size) - 1;
+		guarded_block->size_status = (GET_BLOCK_SIZE(block) - lead_size) | P_BIT | A_BIT;
+		block->size_status = GET_PA_BITS(block) + lead_size;
+		Free_Block(block);
+		block = guarded_block;
+	}
+	Split_Block(block, size_needed);
+
+	if (mprotect(guard, guard_size, PROT_NONE) != 0)
+	{
+		Free_Block(block);
+		return NULL;
+	}
+	guard_map[GUARD_FRAME(guard) / 8] |= 1 << GUARD_FRAME(guard) % 8;
+	Set_Canary(block, size);
+	return block;
+}
+
+/*
+ * Function for making the guard page of a block accessible again before the
+ * block is freed or moved.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * block this is the header of a block for which Is_Guarded is TRUE
+ */
+static void Unguard_Block(block_header *block)
+{
+	BYTE *guard = (BYTE*)block + GET_BLOCK_SIZE(block) - sizeof(size_t) - guard_size;
+	mprotect(guard, guard_size, PROT_READ | PROT_WRITE);
+	guard_map[GUARD_FRAME(guard) / 8] &= ~(1 << GUARD_FRAME(guard) % 8);
+}
+
+/*
+ * These inline functions guard the shared heap in thread-safe mode and do
+ * nothing otherwise.
+ */
+static inline void Lock_Heap()
+{
+	if (thread_safe) pthread_mutex_lock(&heap_lock);
+}
+
+static inline void Unlock_Heap()
+{
+	if (thread_safe) pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * This inline function counts the outcome of an allocation request.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * block this is the allocated block, NULL if the request failed
+ * size_needed this is the block size that was requested
+ */
+static inline void Count_Alloc(block_header *block, size_t size_needed)
+{
+	if (block == NULL)
+	{
+		stats.failed_allocs++;
+		return;
+	}
+	stats.allocs++;
+	stats.alloc_by_class[Get_Class(size_needed)]++;
+}
+
+/*
+ * This inline function adds the calling thread's cache hits to stats.
+ * The caller must hold heap_lock.
+ */
+static inline void Cache_Merge_Counts()
+{
+	stats.allocs += thread_cache.allocs;
+	stats.frees += thread_cache.frees;
+	thread_cache.allocs = 0;
+	thread_cache.frees = 0;
+	for (int i = 0; i < NUM_CLASSES; i++)
+	{
+		stats.alloc_by_class[i] += thread_cache.alloc_by_class[i];
+		thread_cache.alloc_by_class[i] = 0;
+	}
+}
+
+/*
+ * Function for flushing cached blocks of one bin back to the heap until only
+ * keep of them are left. Takes heap_lock once for the whole batch.
+ *
+ * bin this is the bin of the calling thread's cache to flush
+ * keep this is the number of blocks to leave in the bin
+ */
+static void Cache_Flush_Bin(cache_bin *bin, int keep)
+{
+	if (bin->count <= keep)
+		return;
+
+	Lock_Heap();
+	Cache_Merge_Counts();
+	while (bin->count > keep)
+	{
+		block_header *block = TO_BLOCK(bin->head);
+		bin->head = GET_CACHE_ENTRY(block)->next;
+		bin->count--;
+		Free_Block(block);
+	}
+	Unlock_Heap();
+}
+
+/*
+ * Function registered as the thread_cache_key destructor, returns everything
+ * an exiting thread still has cached to the shared heap.
+ */
+static void Cache_Destroy(void *unused)
+{
+	for (int i = 0; i < CACHE_BINS; i++)
+		Cache_Flush_Bin(&thread_cache.bins[i], 0);
+
+	Lock_Heap();
+	Cache_Merge_Counts();
+	Unlock_Heap();
+	thread_cache.registered = FALSE;
+}
+
+/*
+ * This inline function pushes an allocated block on its bin in the calling
+ * thread's cache. The block stays allocated as far as the heap is concerned.
+ */
+static inline void Cache_Push(cache_bin *bin, block_header *block)
+{
+	GET_CACHE_ENTRY(block)->next = bin->head;
+	GET_CACHE_ENTRY(block)->key = CACHE_KEY;
+	bin->head = TO_OFFSET(block);
+	bin->count++;
+	//the entry may lie in the canary padding, which covers nothing now
+	Set_Canary(block, Usable_Size(block));
+}
+
+/*
+ * Function for allocating a small block from the calling thread's cache.
+ * An empty bin is refilled with up to CACHE_BATCH blocks under a single lock,
+ * so only one allocation out of a batch touches the shared heap.
+ *
+ * size_needed this is the block size, at most CACHE_MAX_BLOCK_SIZE
+ * Returns the header of the allocated block, or NULL if nothing fits.
+ */
+static block_header* Cache_Alloc(size_t size_needed)
+{
+	cache_bin *bin = &thread_cache.bins[CACHE_BIN(size_needed)];
+	block_header *block;
+
+	if (bin->count == 0)
+	{
+		//make sure the thread's leftovers get flushed when it exits
+		if (!thread_cache.registered)
+		{
+			pthread_setspecific(thread_cache_key, &thread_cache);
+			thread_cache.registered = TRUE;
+		}
+
+		Lock_Heap();
+		Cache_Merge_Counts();
+		block = Alloc_Block(size_needed);
+		Count_Alloc(block, size_needed);
+		for (int i = 1; block != NULL && i < CACHE_BATCH; i++)
+		{
+			block_header *extra = Alloc_Block(size_needed);
+			if (extra == NULL)
+				break;
+			//an unsplit block may be too big to cache, give it back and stop
+			if (GET_BLOCK_SIZE(extra) > CACHE_MAX_BLOCK_SIZE)
+			{
+				Free_Block(extra);
+				break;
+			}
+			Cache_Push(&thread_cache.bins[CACHE_BIN(GET_BLOCK_SIZE(extra))], extra);
+		}
+		Unlock_Heap();
+
+		return block;
+	}
+
+	block = TO_BLOCK(bin->head);
+	bin->head = GET_CACHE_ENTRY(block)->next;
+	bin->count--;
+	GET_CACHE_ENTRY(block)->key = 0;
+	thread_cache.allocs++;
+	thread_cache.alloc_by_class[Get_Class(size_needed)]++;
+	return block;
+}
+
+/*
+ * Function for freeing a small block into the calling thread's cache.
+ * A bin that grows past CACHE_LIMIT gives half of its blocks back to the heap.
+ *
+ * block this is the header of the allocated block
+ * Returns 0 on success, -1 if the block is already in this thread's cache.
+ */
+static int Cache_Free(block_header *block)
+{
+	cache_bin *bin = &thread_cache.bins[CACHE_BIN(GET_BLOCK_SIZE(block))];
+
+	//the key is only a hint, confirm a double free by searching the bin
+	if (GET_CACHE_ENTRY(block)->key == CACHE_KEY)
+	{
+		for (size_t offset = bin->head; offset != 0; offset = GET_CACHE_ENTRY(TO_BLOCK(offset))->next)
+			if (TO_BLOCK(offset) == block)
+				return -1;
+	}
+
+	if (!thread_cache.registered)
+	{
+		pthread_setspecific(thread_cache_key, &thread_cache);
+		thread_cache.registered = TRUE;
+	}
+
+	Cache_Push(bin, block);
+	thread_cache.frees++;
+	if (bin->count > CACHE_LIMIT)
+		Cache_Flush_Bin(bin, CACHE_LIMIT / 2);
+	return 0;
+}
+
+/*
+ * Function for finding the slab a payload pointer belongs to.
+ *
+ * ptr this is a pointer inside the heap range
+ * Returns the slab holding ptr, or NULL if ptr is not in a slab.
+ */
+static inline slab* Find_Slab(void *ptr)
+{
+	if (slab_map == NULL)
+		return NULL;
+
+	size_t frame = ((BYTE*)ptr - heap_base) / SLAB_SIZE;
+	if ((slab_map[frame / 8] & (1 << frame % 8)) == 0)
+		return NULL;
+	return (slab*)(heap_base + frame * SLAB_SIZE);
+}
+
+/*
+ * Function for marking or unmarking the frame of a slab in slab_map.
+ */
+static inline void Set_Slab_Frame(slab *s, BOOL is_slab)
+{
+	size_t frame = ((BYTE*)s - heap_base) / SLAB_SIZE;
+	if (is_slab) slab_map[frame / 8] |= 1 << frame % 8;
+	else slab_map[frame / 8] &= ~(1 << frame % 8);
+}
+
+/*
+ * Function for linking a slab at the head of its class's partial list.
+ */
+static void Slab_Link(slab *s)
+{
+	size_t *head = &slab_partial[SLAB_CLASS(s->size)];
+	s->prev = 0;
+	s->next = *head;
+	if (s->next != 0)
+		((slab*)(heap_base + s->next))->prev = (BYTE*)s - heap_base;
+	*head = (BYTE*)s - heap_base;
+}
+
+/*
+ * Function for unlinking a slab from its class's partial list.
+ */
+static void Slab_Unlink(slab *s)
+{
+	if (s->prev != 0)
+		((slab*)(heap_base + s->prev))->next = s->next;
+	else
+		slab_partial[SLAB_CLASS(s->size)] = s->next;
+	if (s->next != 0)
+		((slab*)(heap_base + s->next))->prev = s->prev;
+}
+
+/*
+ * Function for carving a new slab out of the boundary-tag heap.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * size this is the object size, a multiple of ALIGNMENT
+ * Returns the new slab, already on its partial list, or NULL if the heap has
+ * no room for one.
+ */
+static slab* Slab_Create(size_t size)
+{
+	block_header *block = Alloc_Aligned_Block(Get_Size_Needed(SLAB_SIZE), SLAB_SIZE);
+	if (block == NULL)
+		return NULL;
+
+	slab *s = (slab*)(block + 1);
+	memset(s, 0, sizeof(slab));
+	s->size = size;
+	s->capacity = (SLAB_SIZE - (SLAB_OBJECTS(s) - (BYTE*)s)) / size;
+	s->free_top = SLAB_NONE;
+	Set_Slab_Frame(s, TRUE);
+	Slab_Link(s);
+	stats.slabs++;
+	return s;
+}
+
+/*
+ * Function for allocating an object from the slabs in O(1).
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * size this is the requested size, at most SLAB_MAX_SIZE
+ * Returns the object, or NULL if no slab could be made for it.
+ */
+static void* Slab_Alloc(size_t size)
+{
+	size_t offset = slab_partial[SLAB_CLASS(size)];
+	slab *s = offset != 0 ? (slab*)(heap_base + offset) : Slab_Create(SLAB_CLASS(size) * ALIGNMENT);
+	if (s == NULL)
+		return NULL;
+
+	//reuse a freed object first, the untouched tail second
+	int index;
+	if (s->free_top != SLAB_NONE)
+	{
+		index = s->free_top;
+		s->free_top = *(uint16_t*)(SLAB_OBJECTS(s) + index * s->size);
+	}
+	else index = s->fresh++;
+
+	s->live[index / 32] |= (uint32_t)1 << index % 32;
+	s->used++;
+	if (s->free_top == SLAB_NONE && s->fresh == s->capacity)
+		Slab_Unlink(s);
+
+	stats.allocs++;
+	stats.alloc_by_class[Get_Class(s->size)]++;
+	stats.slab_objects++;
+	return SLAB_OBJECTS(s) + index * s->size;
+}
+
+/*
+ * Function for freeing an object back to its slab. An empty slab goes back
+ * to the heap unless it is the only one of its class with free objects, so
+ * that a single object allocated and freed in a loop doesn't make a slab
+ * each time.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * s this is the slab holding ptr
+ * ptr this is the object to free
+ * Returns 0 on success, -1 if ptr is not a live object of the slab.
+ */
+static int Slab_Free(slab *s, void *ptr)
+{
+	size_t distance = (BYTE*)ptr - SLAB_OBJECTS(s);
+	if ((BYTE*)ptr < SLAB_OBJECTS(s) || distance % s->size != 0 || distance / s->size >= s->capacity)
+		return -1;
+
+	int index = distance / s->size;
+	uint32_t bit = (uint32_t)1 << index % 32;
+	if ((s->live[index / 32] & bit) == 0)
+		return -1;
+
+	//a full slab has free objects again
+	if (s->free_top == SLAB_NONE && s->fresh == s->capacity)
+		Slab_Link(s);
+
+	s->live[index / 32] &= ~bit;
+	*(uint16_t*)ptr = s->free_top;
+	s->free_top = index;
+	s->used--;
+	stats.frees++;
+	stats.slab_objects--;
+
+	if (s->used == 0 && (s->prev != 0 || s->next != 0))
+	{
+		Slab_Unlink(s);
+		Set_Slab_Frame(s, FALSE);
+		Free_Block((block_header*)s - 1);
+		stats.slabs--;
+	}
+	return 0;
+}
+
+/*
+ * Function for appending calls to the trace ring.
+ * op this is the MEM_TRACE_ operation
+ * size this is the requested size, or alignment for MEM_TRACE_ALIGNED
+ * ptr this is the payload the call returned or was given, may be NULL
+ * op2/size2/ptr2 a second record claimed together with the first, op2 0 if none
+ */
+static void Trace_Record(uint32_t op, size_t size, void *ptr,
+	uint32_t op2, size_t size2, void *ptr2)
+{
+	trace_buffer *ring = trace_ring;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t time = (uint64_t)(now.tv_sec - ring->start.tv_sec) * 1000000000 +
+		now.tv_nsec - ring->start.tv_nsec;
+
+	size_t slot = __sync_fetch_and_add(&ring->next, op2 != 0 ? 2 : 1);
+	mem_trace_record *record = &ring->records[slot & (ring->capacity - 1)];
+	record->time = time;
+	record->offset = ptr == NULL ? 0 : (BYTE*)ptr - heap_base;
+	record->size = size;
+	record->op = op;
+	if (op2 == 0)
+		return;
+
+	record = &ring->records[(slot + 1) & (ring->capacity - 1)];
+	record->time = time;
+	record->offset = ptr2 == NULL ? 0 : (BYTE*)ptr2 - heap_base;
+	record->size = size2;
+	record->op = op2;
+}
+
+/*
+ * Function for recording a Realloc_Mem call that gives up a block, once its
+ * result is held and before the block is released, so that no other
+ * thread's record of either address lands on the wrong side of it.
+ * pending this is TRUE while the call is still to be recorded, then cleared
+ * ptr this is the block given to Realloc_Mem
+ * size this is the new requested size
+ * new_ptr this is the result, NULL if the block is just freed
+ */
+static void Trace_Resize(BOOL *pending, void *ptr, size_t size, void *new_ptr)
+{
+	if (*pending)
+		Trace_Record(MEM_TRACE_REALLOC, 0, ptr, MEM_TRACE_ALLOC, size, new_ptr);
+	*pending = FALSE;
+}
+
+/*
+ * This inline function returns the map_table slot where the search for a
+ * mapping's header starts.
+ */
+static inline size_t Map_Slot(map_header *header)
+{
+	uint64_t hash = (uint64_t)(uintptr_t)header * 0x9E3779B97F4A7C15ULL;
+	return (size_t)(hash >> (64 - MAP_TABLE_BITS));
+}
+
+/*
+ * Function for searching map_table for a mapping's header. The table is
+ * never more than half full, so the search always ends. Caller holds
+ * heap_lock.
+ *
+ * header this is the header to look for
+ * Returns the slot holding header, or the empty slot it would go in.
+ */
+static size_t Map_Probe(map_header *header)
+{
+	size_t i = Map_Slot(header);
+	while (map_table[i] != NULL && map_table[i] != header)
+		i = (i + 1) % MAP_TABLE_SIZE;
+	return i;
+}
+
+/*
+ * Function for finding the mapping a pointer outside the heap is the payload
+ * of. Only map_table is read, so any pointer may be passed. Caller holds
+ * heap_lock.
+ *
+ * ptr this is a pointer outside the heap range
+ * Returns the slot of its header in map_table, or MAP_TABLE_SIZE if ptr is
+ * not the payload of a live mapping.
+ */
+static size_t Find_Mapping(void *ptr)
+{
+	if (map_table == NULL)
+		return MAP_TABLE_SIZE;
+	size_t i = Map_Probe(GET_MAP_HEADER(ptr));
+	return map_table[i] == NULL ? MAP_TABLE_SIZE : i;
+}
+
+/*
+ * Function for taking a header out of map_table. The entries after it in
+ * its run are moved back over the hole when their search starts at or
+ * before it, so no later search stops short of them. Caller holds heap_lock.
+ *
+ * i this is the slot of the header
+ */
+static void Map_Remove(size_t i)
+{
+	map_table[i] = NULL;
+	map_count--;
+	for (size_t j = (i + 1) % MAP_TABLE_SIZE; map_table[j] != NULL;
+		j = (j + 1) % MAP_TABLE_SIZE)
+	{
+		//an entry may move to i unless its search starts after i, up to j
+		size_t home = Map_Slot(map_table[j]);
+		if (i < j ? home <= i || home > j : home <= i && home > j)
+		{
+			map_table[i] = map_table[j];
+			map_table[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/*
+ * Function for putting a header into map_table, which is mapped on first
+ * use. Caller holds heap_lock.
+ *
+ * header this is the header of a new mapping
+ * Returns 0 on success, -1 if the table can't be mapped or is full.
+ */
+static int Map_Insert(map_header *header)
+{
+	if (map_table == NULL)
+	{
+		map_table = mmap(NULL, MAP_TABLE_SIZE * sizeof(map_header*),
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (map_table == MAP_FAILED)
+			map_table = NULL;
+	}
+	if (map_table == NULL || map_count == MAP_MAX)
+		return -1;
+
+	map_table[Map_Probe(header)] = header;
+	map_count++;
+	return 0;
+}
+
+/*
+ * This inline function returns the mapping size for a payload of size
+ * bytes, header included and rounded up to whole pages, or 0 if that
+ * overflows.
+ */
+static inline size_t Get_Map_Size(size_t size)
+{
+	size_t pagesize = getpagesize();
+	if (size > SIZE_MAX - MAP_HEADER_SIZE - pagesize)
+		return 0;
+	return (size + MAP_HEADER_SIZE + pagesize - 1) / pagesize * pagesize;
+}
+
+/*
+ * Function for asking the kernel to back a range with huge pages and to
+ * place it on mem_node, as set up for the heap. Both are only advice, a
+ * range they can't apply to keeps the default pages and policy.
+ *
+ * addr this is the start of the range, page aligned
+ * size this is the size of the range
+ * Returns 0 on success, -1 if binding to mem_node failed.
+ */
+static int Advise_Range(void *addr, size_t size)
+{
+	if (huge_pages && size >= HUGE_PAGE_SIZE)
+		madvise(addr, size, MADV_HUGEPAGE);
+	if (mem_node < 0)
+		return 0;
+
+	unsigned long nodes[MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+	nodes[mem_node / (8 * sizeof(unsigned long))] = 1UL << mem_node % (8 * sizeof(unsigned long));
+	//pages already touched are moved over too
+	return syscall(SYS_mbind, addr, size, MPOL_BIND, nodes, MAX_NODES + 1, MPOL_MF_MOVE) == 0 ? 0 : -1;
+}
+
+/*
+ * Function for allocating a payload in a mapping of its own.
+ *
+ * size this is the requested size, at least map_threshold
+ * Returns the payload, or NULL if the mapping failed.
+ */
+static void* Map_Alloc(size_t size)
+{
+	size_t map_size = Get_Map_Size(size);
+	map_header *header = map_size == 0 ? MAP_FAILED : mmap(NULL, map_size,
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (header != MAP_FAILED)
+		header->map_size = map_size;
+
+	Lock_Heap();
+	if (header == MAP_FAILED || Map_Insert(header) != 0)
+	{
+		stats.failed_allocs++;
+		Unlock_Heap();
+		if (header != MAP_FAILED)
+			munmap(header, map_size);
+		return NULL;
+	}
+	stats.allocs++;
+	stats.alloc_by_class[Get_Class(map_size)]++;
+	stats.mapped++;
+	stats.mapped_bytes += map_size;
+	Unlock_Heap();
+	Advise_Range(header, map_size);
+
+	return (BYTE*)header + MAP_HEADER_SIZE;
+}
+
+/*
+ * Function for unmapping a mapped allocation.
+ *
+ * ptr this is a pointer outside the heap range
+ * Returns 0 on success, -1 if ptr is not the payload of a live mapping.
+ */
+static int Map_Free(void *ptr)
+{
+	map_header *header = GET_MAP_HEADER(ptr);
+
+	Lock_Heap();
+	size_t i = Find_Mapping(ptr);
+	if (i == MAP_TABLE_SIZE)
+	{
+		Unlock_Heap();
+		return -1;
+	}
+	size_t map_size = header->map_size;
+	Map_Remove(i);
+	stats.frees++;
+	stats.mapped--;
+	stats.mapped_bytes -= map_size;
+	Unlock_Heap();
+
+	munmap(header, map_size);
+	return 0;
+}
+
+/*
+ * Function for resizing a mapped allocation with mremap, which moves its
+ * pages instead of copying them if it can't grow in place. It stays mapped
+ * even if it shrinks below map_threshold. heap_lock is held across mremap,
+ * so no other call reads a header that may be moving, and no other thread
+ * can map and record the old address before this call is recorded.
+ *
+ * ptr this is a pointer outside the heap range
+ * size this is the new requested size, not 0
+ * pending see Trace_Resize
+ * Returns the resized payload, or NULL if ptr is not the payload of a live
+ * mapping or on failure.
+ */
+static void* Map_Realloc(void *ptr, size_t size, BOOL *pending)
+{
+	map_header *header = GET_MAP_HEADER(ptr);
+
+	Lock_Heap();
+	size_t i = Find_Mapping(ptr);
+	size_t old_size = i == MAP_TABLE_SIZE ? 0 : header->map_size;
+	size_t map_size = Get_Map_Size(size);
+	map_header *new_header = old_size == 0 || map_size == 0 ? MAP_FAILED :
+		mremap(header, old_size, map_size, MREMAP_MAYMOVE);
+	if (new_header == MAP_FAILED)
+	{
+		if (old_size != 0)
+			stats.failed_allocs++;
+		Unlock_Heap();
+		return NULL;
+	}
+
+	void *new_ptr = (BYTE*)new_header + MAP_HEADER_SIZE;
+	Trace_Resize(pending, ptr, size, new_ptr);
+	stats.reallocs++;
+	if (new_header == header)
+		stats.reallocs_in_place++;
+	stats.mapped_bytes += map_size - old_size;
+	new_header->map_size = map_size;
+	//the slot taken out is free again, so this can't fail
+	Map_Remove(i);
+	Map_Insert(new_header);
+	Unlock_Heap();
+	return new_ptr;
+}
+
+/*
+ * Function for freeing up a previously allocated block.
+ * Argument ptr: address of the block to be freed up.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ * This function should:
+ * - Return -1 if ptr is NULL.
+ * - Return -1 if ptr is not a multiple of ALIGNMENT.
+ * - Return -1 if ptr is outside of the heap space.
+ * - Return -1 if ptr block is already freed.
+ * - USE IMMEDIATE COALESCING if one or both of the adjacent neighbors are free.
+ * - Update header(s) and footer as needed.
+ * In thread-safe mode small blocks go to the calling thread's cache instead,
+ * with MEM_DEFERRED to a quick list. Slab objects go back to their slab,
+ * mapped allocations are unmapped. Debug builds return -1 for a block whose
+ * canary was overwritten and leave it allocated.
+ */
+static int Free_Payload(void *ptr)
+{
+	//Return -1 if ptr is NULL, is not a multiple of ALIGNMENT, or is outside the heap space.
+	if (ptr == NULL || (uintptr_t)ptr % ALIGNMENT != 0)
+		return -1;
+	if ((BYTE*)ptr < (BYTE*)start_block || (BYTE*)ptr >= END_OF_HEAP)
+		return Map_Free(ptr);
+
+	//objects in a slab have no header, their slab takes them back
+	slab *s = Find_Slab(ptr);
+	if (s != NULL)
+	{
+		Lock_Heap();
+		int result = Slab_Free(s, ptr);
+		Unlock_Heap();
+		return result;
+	}
+
+	//init cur_block to be the header of ptr
+	block_header *cur_block = (block_header*)ptr - 1;
+
+	//Return -1 if the block is already freed.
+	if (!IS_ALLOCD(cur_block))
+		return -1;
+	if (!Check_Canary(cur_block))
+	{
+		fprintf(stderr, "Error:mem.c: Free_Mem: block at offset %zu was written past its end\n",
+			TO_OFFSET(cur_block));
+		return -1;
+	}
+
+	if (thread_safe && GET_BLOCK_SIZE(cur_block) <= CACHE_MAX_BLOCK_SIZE &&
+		!IS_TINY(GET_BLOCK_SIZE(cur_block)))
+		return Cache_Free(cur_block);
+
+	BOOL quick = deferred && GET_BLOCK_SIZE(cur_block) <= QUICK_MAX_BLOCK_SIZE &&
+		!IS_TINY(GET_BLOCK_SIZE(cur_block));
+
+	Lock_Heap();
+	//the key is only a hint, confirm a double free by searching the quick list
+	if (quick && GET_LINKS(cur_block)->prev == QUICK_KEY)
+	{
+		for (size_t offset = quick_lists[QUICK_BIN(GET_BLOCK_SIZE(cur_block))]; offset != 0;
+			offset = GET_LINKS(TO_BLOCK(offset))->next)
+		{
+			if (TO_BLOCK(offset) == cur_block)
+			{
+				Unlock_Heap();
+				return -1;
+			}
+		}
+	}
+
+	if (quick) Quick_Push(cur_block);
+	else
+	{
+		if (Is_Guarded(cur_block)) Unguard_Block(cur_block);
+		Free_Block(cur_block);
+	}
+	stats.frees++;
+	Unlock_Heap();
+
+	//Returns 0 on success.
+	return 0;
+}
+
+/*
+ * Function for allocating 'size' bytes of heap memory.
+ * Argument size: requested size for the payload
+ * Returns address of allocated block on success.
+ * Returns NULL on failure.
+ * This function should:
+ * - Check size - Return NULL if zero or if larger than heap space.
+ * - Determine block size rounding up to a multiple of ALIGNMENT and possibly
+ *   adding padding as a result.
+ * - Use BEST-FIT PLACEMENT POLICY to find the block closest to the required block size
+ *   by searching the segregated free lists, or the policy set by Set_Mem_Policy.
+ * - Use SPLITTING to divide the chosen free block into two if it is too large.
+ * - Update header(s) and footer as needed.
+ * With MEM_SLAB small requests come from the slabs, in thread-safe mode
+ * otherwise from the calling thread's cache. With MEM_GUARD large requests
+ * end at a guard page. Requests of at least the Set_Mem_Map_Threshold
+ * threshold get a mapping of their own.
+ * Tips: Be careful with pointer arithmetic.
+ */
+static void* Alloc_Payload(size_t size)
+{
+	//Check size: Return NULL if zero or if larger than heap space.
+	if (size == 0)
+		return NULL;
+	if (map_threshold != 0 && size >= map_threshold)
+		return Map_Alloc(size);
+	if (size > (growable ? reserved_size : heap_size))
+	{
+		Lock_Heap();
+		stats.failed_allocs++;
+		Unlock_Heap();
+		return NULL;
+	}
+
+	//small objects come from the slabs if there is room for them
+	if (slab_map != NULL && size <= SLAB_MAX_SIZE)
+	{
+		Lock_Heap();
+		void *ptr = Slab_Alloc(size);
+		Unlock_Heap();
+		if (ptr != NULL)
+			return ptr;
+	}
+
+	//Determine block size rounding up to a multiple of ALIGNMENT and possibly
+	//adding padding as a result.
+	size_t size_needed = Get_Size_Needed(size);
+	block_header *block;
+
+	if (thread_safe && size_needed <= CACHE_MAX_BLOCK_SIZE && !IS_TINY(size_needed))
+	{
+		block = Cache_Alloc(size_needed);
+	}
+	else
+	{
+		Lock_Heap();
+		if (guard_map != NULL && size >= GUARD_MIN_SIZE) block = Alloc_Guarded_Block(size);
+		else block = Alloc_Block(size_needed);
+		Count_Alloc(block, size_needed);
+		Unlock_Heap();
+	}
+
+	if (block == NULL)
+		return NULL;
+	Set_Canary(block, size);
+
+	//return payload start addr of the block
+	return block + 1;
+}
+
+/*
+ * Function for allocating 'size' bytes of heap memory aligned to alignment,
+ * the untraced body of Alloc_Mem_Aligned.
+ * Returns NULL on failure or if alignment is not a power of two.
+ */
+static void* Alloc_Aligned_Payload(size_t size, size_t alignment)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+		return NULL;
+	if (alignment <= ALIGNMENT)
+		return Alloc_Payload(size);
+	if (size == 0)
+		return NULL;
+
+	Lock_Heap();
+	block_header *block = NULL;
+	if (alignment <= heap_size && size <= (growable ? reserved_size : heap_size) - alignment)
+		block = Alloc_Aligned_Block(Get_Size_Needed(size), alignment);
+	Count_Alloc(block, Get_Size_Needed(size));
+	Unlock_Heap();
+
+	if (block == NULL)
+		return NULL;
+	Set_Canary(block, size);
+	return block + 1;
+}
+
+/*
+ * Function for growing an allocated block in place by absorbing the free
+ * block after it, growing a growable heap first if the block is at its end.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * block this is the header of an allocated block
+ * size_needed this is the block size required, a multiple of ALIGNMENT
+ * Returns TRUE if the block now has at least size_needed bytes.
+ */
+static BOOL Grow_Block(block_header *block, size_t size_needed)
+{
+	block_header *next_block = FIND_NEXT_BLOCK(block);
+	size_t next_free = IS_ALLOCD(next_block) ? 0 : GET_BLOCK_SIZE(next_block);
+
+	if (GET_BLOCK_SIZE(block) + next_free < size_needed)
+	{
+		//only the space at the very end of a growable heap can be extended
+		BOOL at_end = (BYTE*)next_block == END_OF_HEAP ||
+			(next_free != 0 && (BYTE*)FIND_NEXT_BLOCK(next_block) == END_OF_HEAP);
+		if (!growable || !at_end || Grow_Heap(size_needed - GET_BLOCK_SIZE(block)) == NULL)
+			return FALSE;
+		next_block = FIND_NEXT_BLOCK(block);
+		next_free = GET_BLOCK_SIZE(next_block);
+	}
+
+	//take the whole free successor, then give back what isn't needed
+	Remove_Free_Block(next_block);
+	if (TO_OFFSET(block) < compact_mark) compact_mark = TO_OFFSET(block);
+	block->size_status += next_free;
+	heap_used += next_free;
+	stats.coalesces++;
+	Set_Next_PBit(block);
+	Split_Block(block, size_needed);
+	return TRUE;
+}
+
+/*
+ * Function for resizing a slab object. It stays put if the new size still
+ * fits its class, otherwise it moves to a new block or slab.
+ *
+ * s this is the slab holding ptr
+ * ptr this is the object to resize
+ * size this is the new requested size, not 0
+ * pending see Trace_Resize
+ * Returns the resized object, or NULL on failure.
+ */
+static void* Slab_Realloc(slab *s, void *ptr, size_t size, BOOL *pending)
+{
+	Lock_Heap();
+	size_t distance = (BYTE*)ptr - SLAB_OBJECTS(s);
+	BOOL live = (BYTE*)ptr >= SLAB_OBJECTS(s) && distance % s->size == 0 &&
+		distance / s->size < s->capacity &&
+		(s->live[distance / s->size / 32] & (uint32_t)1 << distance / s->size % 32) != 0;
+	size_t old_size = s->size;
+	if (live && size <= old_size)
+	{
+		stats.reallocs++;
+		stats.reallocs_in_place++;
+	}
+	Unlock_Heap();
+
+	if (!live)
+		return NULL;
+	if (size <= old_size)
+		return ptr;
+
+	void *new_ptr = Alloc_Payload(size);
+	if (new_ptr == NULL)
+		return NULL;
+	memcpy(new_ptr, ptr, old_size);
+	Trace_Resize(pending, ptr, size, new_ptr);
+	Free_Payload(ptr);
+
+	Lock_Heap();
+	stats.reallocs++;
+	Unlock_Heap();
+	return new_ptr;
+}
+
+/*
+ * Function for resizing a previously allocated block.
+ * Argument ptr: address of the block to resize, or NULL to just allocate.
+ * Argument size: new requested size for the payload, 0 to just free.
+ * Argument pending: see Trace_Resize.
+ * Returns address of the resized block on success, which is ptr itself if it
+ * could be resized in place.
+ * Returns NULL on failure, ptr stays allocated and unchanged.
+ * This function should:
+ * - Shrink in place by SPLITTING the unused tail off as a free block.
+ * - Grow in place by absorbing a free next block, if it is large enough.
+ * - Otherwise allocate a new block, copy the payload and free the old block.
+ * A block with a guard page always moves, so does a block growing past the
+ * map threshold, into a mapping. Mapped allocations are remapped.
+ */
+static void* Realloc_Payload(void *ptr, size_t size, BOOL *pending)
+{
+	if (ptr == NULL)
+		return Alloc_Payload(size);
+	if (size == 0)
+	{
+		Trace_Resize(pending, ptr, 0, NULL);
+		Free_Payload(ptr);
+		return NULL;
+	}
+
+	//the same checks as Free_Mem, ptr must be an allocated block in the heap or mapped
+	if ((uintptr_t)ptr % ALIGNMENT != 0)
+		return NULL;
+	if (ptr < (void*)start_block || ptr >= (void*)END_OF_HEAP)
+		return Map_Realloc(ptr, size, pending);
+	if (size > (growable ? reserved_size : heap_size) && (map_threshold == 0 || size < map_threshold))
+		return NULL;
+
+	slab *s = Find_Slab(ptr);
+	if (s != NULL)
+		return Slab_Realloc(s, ptr, size, pending);
+
+	block_header *block = (block_header*)ptr - 1;
+	if (!IS_ALLOCD(block))
+		return NULL;
+	if (!Check_Canary(block))
+	{
+		fprintf(stderr, "Error:mem.c: Realloc_Mem: block at offset %zu was written past its end\n",
+			TO_OFFSET(block));
+		return NULL;
+	}
+
+	size_t size_needed = Get_Size_Needed(size);
+	BOOL in_place = !Is_Guarded(block) && (map_threshold == 0 || size < map_threshold);
+
+	Lock_Heap();
+	if (in_place && size_needed <= GET_BLOCK_SIZE(block))
+		Split_Block(block, size_needed);
+	else if (in_place)
+		in_place = Grow_Block(block, size_needed);
+	if (in_place)
+	{
+		Set_Canary(block, size);
+		stats.reallocs++;
+		stats.reallocs_in_place++;
+	}
+	Unlock_Heap();
+
+	if (in_place)
+		return ptr;
+
+	//move-and-copy as the last resort, Alloc_Payload counts a failure
+	void *new_ptr = Alloc_Payload(size);
+	if (new_ptr == NULL)
+		return NULL;
+	size_t old_size = Usable_Size(block);
+	memcpy(new_ptr, ptr, size < old_size ? size : old_size);
+	Trace_Resize(pending, ptr, size, new_ptr);
+	Free_Payload(ptr);
+
+	Lock_Heap();
+	stats.reallocs++;
+	Unlock_Heap();
+	return new_ptr;
+}
+
+/*
+ * Function for getting the usable size of a previously allocated block.
+ * Argument ptr: address returned by Alloc_Mem or Alloc_Mem_Aligned.
+ * Returns the number of payload bytes that may be used, at least the size
+ * that was requested. Debug builds return exactly the requested size since
+ * the rest is canary padding.
+ * Returns 0 if ptr is not an allocated block in the heap space.
+ */
+size_t Size_Mem(void *ptr)
+{
+	if (ptr == NULL || (uintptr_t)ptr % ALIGNMENT != 0)
+		return 0;
+	if ((BYTE*)ptr < (BYTE*)start_block || (BYTE*)ptr >= END_OF_HEAP)
+	{
+		Lock_Heap();
+		size_t i = Find_Mapping(ptr);
+		size_t size = i == MAP_TABLE_SIZE ? 0 :
+			map_table[i]->map_size - MAP_HEADER_SIZE;
+		Unlock_Heap();
+		return size;
+	}
+
+	slab *s = Find_Slab(ptr);
+	if (s != NULL)
+	{
+		size_t distance = (BYTE*)ptr - SLAB_OBJECTS(s);
+		if ((BYTE*)ptr < SLAB_OBJECTS(s) || distance % s->size != 0 || distance / s->size >= s->capacity)
+			return 0;
+
+		//a freed object has its live bit clear, like a freed block's a-bit
+		size_t index = distance / s->size;
+		if ((s->live[index / 32] & (uint32_t)1 << index % 32) == 0)
+			return 0;
+		return s->size;
+	}
+
+	block_header *block = (block_header*)ptr - 1;
+	if (!IS_ALLOCD(block))
+		return 0;
+
+#ifdef MEM_DEBUG
+	return *GET_CANARY(block) ^ CANARY_KEY;
+#else
+	return Usable_Size(block);
+#endif
+}
+
+/*
+ * Function for looking up a live handle.
+ * Returns its entry, or NULL if handle was never handed out or is freed.
+ */
+static handle_entry* Get_Handle(mem_handle handle)
+{
+	if (handle == 0 || handle > handle_count || handle_table[handle - 1].offset == 0)
+		return NULL;
+	return &handle_table[handle - 1];
+}
+
+/*
+ * Function for finding the handle of a block the compactor may move.
+ *
+ * block this is the header of an allocated block
+ * Returns the entry of the block's handle if it has one and isn't locked,
+ * NULL otherwise.
+ */
+static handle_entry* Find_Movable(block_header *block)
+{
+	if (handle_table == NULL)
+		return NULL;
+
+	//any block may hold a handle-like word, only the entry pointing back counts
+	handle_entry *entry = Get_Handle(*HANDLE_WORD(block));
+	if (entry == NULL || entry->offset != TO_OFFSET(block) || entry->locks != 0)
+		return NULL;
+	return entry;
+}
+
+/*
+ * Function for moving a block down into the free block in front of it, so
+ * that the free space ends up after the block, merged with whatever free
+ * block follows.
+ * The caller must hold heap_lock in thread-safe mode.
+ *
+ * free_block this is the header of a free block
+ * block this is the header of the block after it, with an unlocked handle
+ * entry this is that handle's entry
+ */
+static void Slide_Block(block_header *free_block, block_header *block, handle_entry *entry)
+{
+	size_t free_size = GET_BLOCK_SIZE(free_block);
+	size_t size = GET_BLOCK_SIZE(block);
+
+	Remove_Free_Block(free_block);
+	memmove(free_block + 1, block + 1, size - sizeof(block_header));
+	free_block->size_status = (GET_PA_BITS(free_block) & P_BIT) | size | A_BIT;
+	entry->offset = TO_OFFSET(free_block);
+
+	//the space left behind is freed like a block of its own to coalesce it
+	block_header *tail = (block_header*)((BYTE*)free_block + size);
+	tail->size_status = free_size | P_BIT | A_BIT;
+	heap_used += free_size;
+	Free_Block(tail);
+	stats.compact_moves++;
+	stats.compact_bytes += size;
+}
+
+/*
+ * Function for allocating a movable block.
+ * Argument size: requested size for the payload
+ * Returns a handle for the block on success, to be locked before use.
+ * Returns 0 on failure.
+ * The block comes straight from the heap, never from a slab, thread cache,
+ * quick list or mapping, and has one more word holding its handle.
+ */
+mem_handle Handle_Alloc(size_t size)
+{
+	if (size == 0 || size > heap_size)
+		return 0;
+
+	Lock_Heap();
+	if (handle_table == NULL)
+	{
+		handle_table = mmap(NULL, HANDLE_MAX * sizeof(handle_entry), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (handle_table == MAP_FAILED)
+			handle_table = NULL;
+	}
+	if (handle_table == NULL || (handle_free == 0 && handle_count == HANDLE_MAX))
+	{
+		stats.failed_allocs++;
+		Unlock_Heap();
+		return 0;
+	}
+
+	size_t size_needed = Get_Size_Needed(size + sizeof(size_t));
+	block_header *block = Alloc_Block(size_needed);
+	Count_Alloc(block, size_needed);
+	if (block == NULL)
+	{
+		Unlock_Heap();
+		return 0;
+	}
+
+	//reuse a free entry before taking a new one
+	mem_handle handle = handle_free != 0 ? handle_free : ++handle_count;
+	handle_entry *entry = &handle_table[handle - 1];
+	handle_free = handle == handle_free ? entry->next_free : handle_free;
+	entry->offset = TO_OFFSET(block);
+	entry->locks = 0;
+	entry->next_free = 0;
+	*HANDLE_WORD(block) = handle;
+	stats.handles++;
+	Unlock_Heap();
+	return handle;
+}
+
+/*
+ * Function for pinning a movable block and getting its payload.
+ * Argument handle: handle returned by Handle_Alloc.
+ * Returns the payload, which stays put until Handle_Unlock is called as many
+ * times as Handle_Lock.
+ * Returns NULL if handle is not a live handle.
+ */
+void* Handle_Lock(mem_handle handle)
+{
+	Lock_Heap();
+	handle_entry *entry = Get_Handle(handle);
+	void *ptr = NULL;
+	if (entry != NULL)
+	{
+		entry->locks++;
+		ptr = TO_BLOCK(entry->offset) + 1;
+	}
+	Unlock_Heap();
+	return ptr;
+}
+
+/*
+ * Function for unpinning a movable block, its payload pointer must not be
+ * used after the last unlock.
+ * Argument handle: handle returned by Handle_Alloc.
+ * Returns 0 on success.
+ * Returns -1 if handle is not a live, locked handle.
+ */
+int Handle_Unlock(mem_handle handle)
+{
+	Lock_Heap();
+	handle_entry *entry = Get_Handle(handle);
+	int result = -1;
+	if (entry != NULL && entry->locks != 0)
+	{
+		entry->locks--;
+		result = 0;
+	}
+	Unlock_Heap();
+	return result;
+}
+
+/*
+ * Function for freeing a movable block and its handle.
+ * Argument handle: handle returned by Handle_Alloc.
+ * Returns 0 on success.
+ * Returns -1 if handle is not a live handle or is still locked.
+ */
+int Handle_Free(mem_handle handle)
+{
+	Lock_Heap();
+	handle_entry *entry = Get_Handle(handle);
+	if (entry == NULL || entry->locks != 0)
+	{
+		Unlock_Heap();
+		return -1;
+	}
+
+	Free_Block(TO_BLOCK(entry->offset));
+	stats.frees++;
+	stats.handles--;
+	entry->offset = 0;
+	entry->next_free = handle_free;
+	handle_free = handle;
+	Unlock_Heap();
+	return 0;
+}
+
+/*
+ * Function for running one bounded step of heap compaction.
+ * Argument budget: bytes the step may spend, counting the bytes of every
+ *   block moved and a header's worth for every block looked at. The first
+ *   block of a step is moved even if it is larger.
+ * Each unlocked movable block that follows a free block slides down into
+ * it, so the free space collects after the block and merges with the next
+ * free block. Other blocks stay put and the free space stops in front of
+ * them. A step resumes where the last one stopped, so calling this in idle
+ * time compacts the heap a little at a time.
+ * Returns 1 if the pass over the heap isn't finished.
+ * Returns 0 once it reached the end of the heap; the next step starts over.
+ */
+int Compact_Mem(size_t budget)
+{
+	Lock_Heap();
+	size_t offset = compact_cursor < compact_mark ? compact_cursor : compact_mark;
+	block_header *block = offset == 0 ? start_block : TO_BLOCK(offset);
+	size_t spent = 0;
+	BOOL moved = FALSE;
+
+	while ((BYTE*)block < END_OF_HEAP && spent < budget)
+	{
+		spent += sizeof(block_header);
+		block_header *next_block = FIND_NEXT_BLOCK(block);
+		if (IS_ALLOCD(block) || (BYTE*)next_block >= END_OF_HEAP)
+		{
+			block = next_block;
+			continue;
+		}
+
+		//the block after a free block is allocated, slide it down if it may move
+		handle_entry *entry = Find_Movable(next_block);
+		if (entry == NULL)
+		{
+			block = next_block;
+			continue;
+		}
+		if (moved && spent + GET_BLOCK_SIZE(next_block) > budget)
+			break;
+		spent += GET_BLOCK_SIZE(next_block);
+		Slide_Block(block, next_block, entry);
+		moved = TRUE;
+
+		//continue at the free space it left behind
+		block = FIND_NEXT_BLOCK(block);
+	}
+
+	int more = (BYTE*)block < END_OF_HEAP;
+	compact_cursor = more ? TO_OFFSET(block) : 0;
+	compact_mark = SIZE_MAX;
+	Unlock_Heap();
+	return more;
+}
+
+/*
+ * Function for reporting a broken invariant found while checking the heap.
+ *
+ * offset this is the offset of the block at fault
+ * what this is what is wrong with it
+ * Returns -1.
+ */
+static int Check_Fail(size_t offset, const char *what)
+{
+	fprintf(stderr, "Error:mem.c: Check_Mem: block at offset %zu: %s\n", offset, what);
+	return -1;
+}
+
+/*
+ * This inline function tells whether an index entry points into the heap.
+ */
+static inline BOOL Check_Offset(size_t offset)
+{
+	return TO_BLOCK(offset) >= start_block && (BYTE*)TO_BLOCK(offset) < END_OF_HEAP;
+}
+
+/*
+ * Function for counting the nodes of a subtree of the tree index, checking
+ * that each is a free block linked back to its parent, ordered after its
+ * left child and without a red child if it is red.
+ *
+ * offset this is the root of the subtree, 0 for none
+ * parent this is the offset of its parent, 0 for the root
+ * Returns the number of nodes, or -1 after reporting a broken node.
+ */
+static long Check_Tree(size_t offset, size_t parent)
+{
+	if (offset == 0)
+		return 0;
+	if (!Check_Offset(offset))
+		return Check_Fail(offset, "tree node outside the heap");
+
+	tree_node *node = NODE(offset);
+	if (IS_ALLOCD(TO_BLOCK(offset)))
+		return Check_Fail(offset, "allocated block in the tree");
+	if (node->parent != parent)
+		return Check_Fail(offset, "tree node not linked to its parent");
+	if (node->color == RED && (COLOR(node->left) == RED || COLOR(node->right) == RED))
+		return Check_Fail(offset, "red tree node with a red child");
+	if (node->left != 0 && Check_Offset(node->left) && !Tree_Less(node->left, offset))
+		return Check_Fail(offset, "tree node ordered before its left child");
+
+	long left = Check_Tree(node->left, offset);
+	long right = left < 0 ? -1 : Check_Tree(node->right, offset);
+	return right < 0 ? -1 : left + right + 1;
+}
+
+/*
+ * Function for checking that the free lists, tree and quick lists hold
+ * exactly the blocks they should, each linked back to the previous one.
+ * List walks are cut off once they hold more entries than there can be.
+ *
+ * indexed this is the number of free blocks found in the heap that are large
+ * enough to be indexed
+ * Returns 0, or -1 after reporting a broken entry.
+ */
+static int Check_Index(size_t indexed)
+{
+	size_t count = 0;
+	for (int i = 0; i < NUM_CLASSES; i++)
+	{
+		size_t prev = 0;
+		size_t largest = 0;
+		for (size_t offset = free_lists[i]; offset != 0; offset = GET_LINKS(TO_BLOCK(offset))->next)
+		{
+			if (!Check_Offset(offset))
+				return Check_Fail(offset, "free list entry outside the heap");
+			block_header *block = TO_BLOCK(offset);
+			if (IS_ALLOCD(block))
+				return Check_Fail(offset, "allocated block on a free list");
+			if (IN_TREE(block) || Get_Class(GET_BLOCK_SIZE(block)) != i)
+				return Check_Fail(offset, "free block on the wrong free list");
+			if (GET_LINKS(block)->prev != prev)
+				return Check_Fail(offset, "free list links don't match");
+			if (++count > indexed)
+				return Check_Fail(offset, "free lists hold more blocks than the heap");
+			if (GET_BLOCK_SIZE(block) > largest)
+				largest = GET_BLOCK_SIZE(block);
+			prev = offset;
+		}
+		if (largest != list_largest[i])
+			return Check_Fail(0, "largest free list size doesn't match the list");
+	}
+
+	long in_tree = Check_Tree(tree_root, 0);
+	if (in_tree < 0)
+		return -1;
+	if (count + in_tree != indexed)
+		return Check_Fail(0, "free index doesn't hold every free block");
+
+	count = 0;
+	for (int i = 0; i < QUICK_BINS; i++)
+	{
+		for (size_t offset = quick_lists[i]; offset != 0; offset = GET_LINKS(TO_BLOCK(offset))->next)
+		{
+			if (!Check_Offset(offset))
+				return Check_Fail(offset, "quick list entry outside the heap");
+			block_header *block = TO_BLOCK(offset);
+			if (!IS_ALLOCD(block) || GET_LINKS(block)->prev != QUICK_KEY)
+				return Check_Fail(offset, "quick list entry not marked as such");
+			if (QUICK_BIN(GET_BLOCK_SIZE(block)) != i)
+				return Check_Fail(offset, "block on the wrong quick list");
+			if (++count > stats.quick_blocks)
+				return Check_Fail(offset, "quick lists hold more blocks than counted");
+		}
+	}
+	if (count != stats.quick_blocks)
+		return Check_Fail(0, "quick lists hold fewer blocks than counted");
+	return 0;
+}
+
+/*
+ * Function for checking the whole heap, see Check_Mem.
+ * The caller must hold heap_lock in thread-safe mode.
+ * Returns 0, or -1 after reporting the first broken invariant.
+ */
+static int Check_Heap()
+{
+	block_header *block = start_block;
+	BOOL prev_allocd = TRUE;
+	size_t used = 0;
+	size_t free_bytes = 0;
+	size_t free_blocks = 0;
+	size_t indexed = 0;
+	size_t slab_objects = 0;
+
+	while ((BYTE*)block < END_OF_HEAP)
+	{
+		size_t size = GET_BLOCK_SIZE(block);
+		if (size % ALIGNMENT != 0 || size < min_alloc_size || size > (size_t)(END_OF_HEAP - (BYTE*)block))
+			return Check_Fail(TO_OFFSET(block), "size is not a block size");
+		if ((IS_PREV_ALLOCD(block) != 0) != prev_allocd)
+			return Check_Fail(TO_OFFSET(block), "p-bit doesn't match the previous block");
+
+		if (IS_ALLOCD(block))
+		{
+			used += size;
+			if (!Check_Canary(block))
+				return Check_Fail(TO_OFFSET(block), "payload was written past its end");
+
+			//a slab's counts must agree with its bitmap of live objects
+			slab *s = Find_Slab(block + 1);
+			if (s == (slab*)(block + 1))
+			{
+				size_t live = 0;
+				for (int i = 0; i < SLAB_MAP_WORDS; i++)
+					live += __builtin_popcount(s->live[i]);
+				if (s->used != live || s->fresh > s->capacity)
+					return Check_Fail(TO_OFFSET(block), "slab counts don't match its objects");
+				slab_objects += live;
+			}
+		}
+		else
+		{
+			if (!prev_allocd)
+				return Check_Fail(TO_OFFSET(block), "free block after a free block");
+			if (((block_header*)FIND_NEXT_BLOCK(block) - 1)->size_status != size)
+				return Check_Fail(TO_OFFSET(block), "footer doesn't match the header");
+			free_bytes += size;
+			free_blocks++;
+			if (!IS_TINY(size))
+				indexed++;
+		}
+
+		prev_allocd = IS_ALLOCD(block) != 0;
+		block = FIND_NEXT_BLOCK(block);
+	}
+
+	if (((block_header*)END_OF_HEAP)->size_status != (A_BIT | (prev_allocd ? P_BIT : 0)))
+		return Check_Fail(TO_OFFSET(END_OF_HEAP), "end mark doesn't match the last block");
+	if (used != heap_used)
+		return Check_Fail(0, "heap_used doesn't match the allocated blocks");
+	if (free_bytes != stats.free_bytes || free_blocks != stats.free_blocks)
+		return Check_Fail(0, "free block counts don't match the free blocks");
+	if (slab_objects != stats.slab_objects)
+		return Check_Fail(0, "slab object count doesn't match the slabs");
+	if (map_count != stats.mapped)
+		return Check_Fail(0, "mapping count doesn't match the mapping table");
+
+	//every live handle must point at an allocated block holding it
+	for (size_t i = 0; i < handle_count; i++)
+	{
+		size_t offset = handle_table[i].offset;
+		if (offset == 0)
+			continue;
+		if (!Check_Offset(offset) || !IS_ALLOCD(TO_BLOCK(offset)) ||
+			*HANDLE_WORD(TO_BLOCK(offset)) != i + 1)
+			return Check_Fail(offset, "handle doesn't match its block");
+	}
+
+	return Check_Index(indexed);
+}
+
+/*
+ * Function for checking the heap for corruption.
+ * Every block must have a size that is a multiple of ALIGNMENT and fits in
+ * the heap and a p-bit matching the block before it. Free blocks must have a
+ * footer equal to their size and no free neighbor, allocated blocks an
+ * intact canary in debug builds. The sizes must add up to heap_used and the
+ * statistics, and the free index and quick lists must hold just the blocks
+ * they should. Takes time linear in the number of blocks, so it can be run
+ * every so often under load, see MEM_CHECK.
+ * Returns 0 if the heap is consistent.
+ * Returns -1 after printing the first problem found to stderr.
+ */
+int Check_Mem()
+{
+	if (start_block == NULL)
+		return -1;
+
+	Lock_Heap();
+	int result = Check_Heap();
+	Unlock_Heap();
+	return result;
+}
+
+/*
+ * Function for running Check_Mem on every check_interval-th call of the
+ * public API, aborting if the heap is corrupt.
+ */
+static void Check_Periodically()
+{
+	if (__sync_add_and_fetch(&check_calls, 1) % check_interval == 0 && Check_Mem() != 0)
+		abort();
+}
+
+/*
+ * Function for allocating 'size' bytes of heap memory.
+ * Argument size: requested size for the payload
+ * Returns address of allocated block on success.
+ * Returns NULL on failure.
+ * See Alloc_Payload, the call is recorded while tracing, and checked with MEM_CHECK.
+ */
+void* Alloc_Mem(size_t size)
+{
+	void *ptr = Alloc_Payload(size);
+	if (tracing)
+		Trace_Record(MEM_TRACE_ALLOC, size, ptr, 0, 0, NULL);
+	if (check_interval != 0)
+		Check_Periodically();
+	return ptr;
+}
+
+/*
+ * Function for allocating 'size' bytes of heap memory aligned to alignment.
+ * Argument size: requested size for the payload
+ * Argument alignment: required payload alignment, a power of two
+ * Returns address of allocated block on success.
+ * Returns NULL on failure or if alignment is not a power of two.
+ * The block is freed with Free_Mem like any other.
+ * See Alloc_Aligned_Payload, the call is recorded while tracing, and checked
+ * with MEM_CHECK.
+ */
+void* Alloc_Mem_Aligned(size_t size, size_t alignment)
+{
+	void *ptr = Alloc_Aligned_Payload(size, alignment);
+	if (tracing)
+		Trace_Record(MEM_TRACE_ALIGNED, alignment, NULL, MEM_TRACE_ALLOC, size, ptr);
+	if (check_interval != 0)
+		Check_Periodically();
+	return ptr;
+}
+
+/*
+ * Function for resizing a previously allocated block.
+ * Argument ptr: address of the block to resize, or NULL to just allocate.
+ * Argument size: new requested size for the payload, 0 to just free.
+ * Returns address of the resized block on success, which is ptr itself if it
+ * could be resized in place.
+ * Returns NULL on failure, ptr stays allocated and unchanged.
+ * See Realloc_Payload, the call is recorded while tracing, and checked with MEM_CHECK.
+ */
+void* Realloc_Mem(void *ptr, size_t size)
+{
+	//a call that gives up a block is recorded in Realloc_Payload, see Trace_Resize
+	BOOL pending = tracing;
+	void *new_ptr = Realloc_Payload(ptr, size, &pending);
+	if (pending)
+		Trace_Record(MEM_TRACE_REALLOC, 0, ptr, MEM_TRACE_ALLOC, size, new_ptr);
+	if (check_interval != 0)
+		Check_Periodically();
+	return new_ptr;
+}
+
+/*
+ * Function for freeing up a previously allocated block.
+ * Argument ptr: address of the block to be freed up.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ * See Free_Payload, the call is recorded while tracing, and checked with MEM_CHECK.
+ */
+int Free_Mem(void *ptr)
+{
+	//recorded before the block can be handed out again
+	if (tracing)
+		Trace_Record(MEM_TRACE_FREE, 0, ptr, 0, 0, NULL);
+	int result = Free_Payload(ptr);
+	if (check_interval != 0)
+		Check_Periodically();
+	return result;
+}
+
+/*
+ * Function for finding the size of the largest free block.
+ * In the tree index it is the rightmost node; otherwise it is the largest
+ * size kept for the highest non-empty free list.
+ */
+static size_t Largest_Free_Block()
+{
+	if (free_index == MEM_TREE_INDEX && tree_root != 0)
+	{
+		size_t cur = tree_root;
+		while (NODE(cur)->right != 0)
+			cur = NODE(cur)->right;
+		return GET_BLOCK_SIZE(TO_BLOCK(cur));
+	}
+
+	for (int size_class = NUM_CLASSES - 1; size_class >= 0; size_class--)
+	{
+		if (list_largest[size_class] != 0)
+			return list_largest[size_class];
+	}
+
+	return 0;
+}
+
+/*
+ * Function for reading the heap statistics without walking the heap.
+ * Counters are maintained as blocks are allocated, freed, split and
+ * coalesced, so this only copies them. In thread-safe mode, small block cache
+ * hits of other threads are included once those threads next take the lock.
+ * Argument out: where to store the statistics.
+ */
+void Mem_Stats(mem_stats *out)
+{
+	Lock_Heap();
+	if (thread_safe)
+		Cache_Merge_Counts();
+
+	*out = stats;
+	out->heap_size = heap_size;
+	out->used_bytes = heap_used;
+	out->largest_free = Largest_Free_Block();
+	out->page_size = page_size;
+	Unlock_Heap();
+}
+
+/*
+ * Function for choosing the placement policy, it may be changed at any time.
+ * Argument new_policy: MEM_BEST_FIT, MEM_FIRST_FIT, MEM_NEXT_FIT or MEM_GOOD_FIT.
+ * Argument candidates: for good-fit, how many fitting blocks to compare
+ * before taking the best of them, 0 for GOOD_FIT_CANDIDATES.
+ * Argument tolerance: for good-fit, take a block at once if it is at most
+ * this many bytes larger than needed.
+ * Returns 0 on success.
+ * Returns -1 if the policy is unknown.
+ */
+int Set_Mem_Policy(int new_policy, size_t candidates, size_t tolerance)
+{
+	if (new_policy < MEM_BEST_FIT || new_policy > MEM_GOOD_FIT)
+		return -1;
+
+	Lock_Heap();
+	policy = new_policy;
+	good_fit_candidates = candidates != 0 ? candidates : GOOD_FIT_CANDIDATES;
+	good_fit_tolerance = tolerance;
+	memset(rovers, 0, sizeof(rovers));
+	rover_size = 0;
+	rover_offset = 0;
+	Unlock_Heap();
+	return 0;
+}
+
+/*
+ * Function for choosing which requests bypass the heap.
+ * Argument threshold: smallest requested size given a mapping of its own,
+ *   0 to serve every request from the heap (the default).
+ * Mapped allocations are freed with Free_Mem and resized with Realloc_Mem
+ * like any other, Alloc_Mem_Aligned always uses the heap.
+ */
+void Set_Mem_Map_Threshold(size_t threshold)
+{
+	Lock_Heap();
+	map_threshold = threshold;
+	Unlock_Heap();
+}
+
+/*
+ * Function for placing the heap on one NUMA node.
+ * Argument node: node to bind the heap and later mappings to, -1 to stop
+ *   binding mappings made from now on.
+ * Pages of the heap already in use move to the node, and the pages it
+ * commits as it grows are taken from the node only.
+ * Returns 0 on success.
+ * Returns -1 if the node doesn't exist or the kernel has no NUMA support.
+ */
+int Set_Mem_Node(int node)
+{
+	if (node < -1 || node >= MAX_NODES || heap_base == NULL)
+		return -1;
+
+	Lock_Heap();
+	int old_node = mem_node;
+	mem_node = node;
+	if (node >= 0 && Advise_Range(heap_base, reserved_size) != 0)
+		mem_node = old_node;
+	int result = mem_node == node ? 0 : -1;
+	Unlock_Heap();
+	return result;
+}
+
+/*
+ * Function for starting to record calls into a new trace ring.
+ * Argument records: ring size in records, rounded up to a power of two,
+ * 0 for MEM_TRACE_RECORDS. Older records are overwritten when it is full.
+ * The ring of an earlier start is left mapped, see trace_ring.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ */
+int Trace_Mem_Start(size_t records)
+{
+	if (records == 0)
+		records = MEM_TRACE_RECORDS;
+	size_t capacity = 1;
+	while (capacity < records)
+		capacity <<= 1;
+
+	tracing = FALSE;
+	//mapped outside the heap so that tracing does not change what it records
+	size_t ring_size = sizeof(trace_buffer) + capacity * sizeof(mem_trace_record);
+	trace_buffer *ring = mmap(NULL, ring_size,
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return -1;
+
+	//the ring is complete before a recorder can find it
+	ring->capacity = capacity;
+	clock_gettime(CLOCK_MONOTONIC, &ring->start);
+	__sync_synchronize();
+	trace_ring = ring;
+	tracing = TRUE;
+	return 0;
+}
+
+/*
+ * Function for pausing the trace recorder, the ring is kept for saving.
+ */
+void Trace_Mem_Stop()
+{
+	tracing = FALSE;
+}
+
+/*
+ * Function for saving the trace ring to a file, oldest record first.
+ * The recorder should be stopped so no thread appends while it is written.
+ * Argument path: file to create or overwrite.
+ * Returns the number of records saved on success.
+ * Returns -1 on failure.
+ */
+long Trace_Mem_Save(const char *path)
+{
+	trace_buffer *ring = trace_ring;
+	if (ring == NULL)
+		return -1;
+
+	mem_trace_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MEM_TRACE_MAGIC, sizeof(header.magic));
+	header.version = MEM_TRACE_VERSION;
+	header.flags = init_flags;
+	header.heap_size = init_region_size;
+	header.records = ring->next < ring->capacity ? ring->next : ring->capacity;
+	header.dropped = ring->next - header.records;
+
+	//plain write(2), under LD_PRELOAD stdio would allocate from this heap
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+
+	BOOL ok = write(fd, &header, sizeof(header)) == sizeof(header);
+	size_t first = header.dropped & (ring->capacity - 1);
+	size_t count = header.records;
+	//the oldest record sits at first when the ring has wrapped
+	while (ok && count > 0)
+	{
+		size_t chunk = ring->capacity - first;
+		if (chunk > count)
+			chunk = count;
+		size_t bytes = chunk * sizeof(mem_trace_record);
+		ok = write(fd, ring->records + first, bytes) == (ssize_t)bytes;
+		first = 0;
+		count -= chunk;
+	}
+
+	if (close(fd) != 0 || !ok)
+		return -1;
+	return header.records;
+}
+
+/*
+ * Function registered with atexit when MEM_TRACE_FILE is set.
+ */
+static void Trace_Save_At_Exit()
+{
+	Trace_Mem_Stop();
+	if (Trace_Mem_Save(trace_path) < 0)
+		fprintf(stderr, "Error:mem.c: Cannot save the trace to %s\n", trace_path);
+}
+
+/*
+ * Function used to initialize the memory allocator with the default options.
+ * Intended to be called ONLY once by a program.
+ * Argument sizeOfRegion: the size of the heap space to be allocated.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ */
+int Init_Mem(size_t sizeOfRegion) {
+	return Init_Mem_Flags(sizeOfRegion, 0);
+}
+
+/*
+ * Function used to initialize the memory allocator.
+ * Intended to be called ONLY once by a program.
+ * Argument sizeOfRegion: the size of the heap space to be allocated.
+ * Argument flags: MEM_* options from mem.h or'd together, 0 for the defaults.
+ *   MEM_TREE_INDEX => index free blocks in a size-ordered red-black tree
+ *                     instead of the segregated free lists.
+ *   MEM_THREAD_SAFE => lock the heap and give each thread a small block cache.
+ *   MEM_GROWABLE => grow the heap past sizeOfRegion on demand and return
+ *                   large free space at its end to the OS.
+ *   MEM_SLAB => serve requests of up to SLAB_MAX_SIZE bytes from slabs.
+ *   MEM_DEFERRED => put small freed blocks on quick lists by exact size and
+ *                   coalesce them lazily.
+ *   MEM_COMPACT => give requests of up to a word a two word block.
+ *   MEM_GUARD => end the payload of large requests at an inaccessible page.
+ *   MEM_HUGE_PAGES => ask for transparent huge pages for the heap and for
+ *                     mappings of large requests.
+ *   MEM_HUGETLB => take the heap from the reserved huge page pool, falling
+ *                  back to MEM_HUGE_PAGES if the pool is too small or the
+ *                  heap is growable or guarded.
+ * If the MEM_TRACE_FILE environment variable is set, every call is recorded
+ * and the trace is saved to that file when the program exits. If MEM_CHECK
+ * is set to N, every Nth call runs Check_Mem and aborts on corruption.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ */
+int Init_Mem_Flags(size_t sizeOfRegion, int flags) {
+	size_t pagesize;
+	size_t padsize;
+	int fd;
+	size_t alloc_size;
+	size_t map_size;
+	void* space_ptr;
+	block_header* end_mark;
+	static int allocated_once = 0;
+
+	if (0 != allocated_once || start_block != NULL) {
+		fprintf(stderr,
+			"Error:mem.c: Init_Mem has allocated space during a previous call\n");
+		return -1;
+	}
+	if (sizeOfRegion == 0) {
+		fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
+		return -1;
+	}
+
+	// Get the pagesize
+	pagesize = getpagesize();
+
+	// Calculate padsize as the padding required to round up sizeOfRegion 
+	// to a multiple of pagesize
+	padsize = sizeOfRegion % pagesize;
 	padsize = (pagesize - padsize) % pagesize;
 
 	alloc_size = sizeOfRegion + padsize;
 
-	// Using mmap to allocate memory
-	fd = open("/dev/zero", O_RDWR);
-	if (-1 == fd) {
-		fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
-		return -1;
+	// A growable heap reserves its whole range and commits the first part
+	growable = (flags & MEM_GROWABLE) ? TRUE : FALSE;
+	map_size = alloc_size;
+	if (growable && map_size < RESERVE_SIZE)
+		map_size = RESERVE_SIZE;
+
+	// Huge pages need the whole range in huge page units
+	huge_pages = (flags & (MEM_HUGE_PAGES | MEM_HUGETLB)) ? TRUE : FALSE;
+	page_size = pagesize;
+	if (huge_pages)
+		map_size = (map_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	// Reserved huge pages can't be made inaccessible a base page at a time
+	space_ptr = MAP_FAILED;
+	if ((flags & MEM_HUGETLB) && !growable && !(flags & MEM_GUARD)) {
+		space_ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (MAP_FAILED != space_ptr)
+			page_size = HUGE_PAGE_SIZE;
 	}
-	space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
-		fd, 0);
+
+	// Using mmap to allocate memory
 	if (MAP_FAILED == space_ptr) {
-		fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
-		allocated_once = 0;
+		fd = open("/dev/zero", O_RDWR);
+		if (-1 == fd) {
+			fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
+			return -1;
+		}
+		space_ptr = mmap(NULL, map_size + (huge_pages ? HUGE_PAGE_SIZE : 0),
+			growable ? PROT_NONE : PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | (growable ? MAP_NORESERVE : 0), fd, 0);
+		close(fd);
+		if (MAP_FAILED == space_ptr) {
+			fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+			allocated_once = 0;
+			return -1;
+		}
+	}
+
+	// Trim the extra space so the heap starts on a huge page
+	if (huge_pages && page_size != HUGE_PAGE_SIZE) {
+		BYTE *aligned = (BYTE*)(((uintptr_t)space_ptr + HUGE_PAGE_SIZE - 1) &
+			~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+		if (aligned != (BYTE*)space_ptr)
+			munmap(space_ptr, aligned - (BYTE*)space_ptr);
+		munmap(aligned + map_size, HUGE_PAGE_SIZE - (aligned - (BYTE*)space_ptr));
+		space_ptr = aligned;
+		if (madvise(space_ptr, map_size, MADV_HUGEPAGE) == 0)
+			page_size = HUGE_PAGE_SIZE;
+	}
+	if (growable && mprotect(space_ptr, alloc_size, PROT_READ | PROT_WRITE) != 0) {
+		fprintf(stderr, "Error:mem.c: mprotect cannot commit space\n");
+		munmap(space_ptr, map_size);
 		return -1;
 	}
 
 	allocated_once = 1;
 
 	// for double word alignment and end mark
-	alloc_size -= 8;
+	alloc_size -= 2 * sizeof(block_header);
 
 	// To begin with there is only one big free block
 	// initialize heap so that start block meets 
@@ -342,16 +3477,250 @@ int Init_Mem(int sizeOfRegion) {
 	// Marking the previous block as used
 	start_block->size_status += 2;
 
-	// Setting up the end mark and marking it as used
+	// Setting up the end mark and marking it as used, the block before it is free
 	end_mark->size_status = 1;
 
 	// Setting up the footer
-	block_header *footer = (block_header*)((char*)start_block + alloc_size - 4);
+	block_header *footer = (block_header*)((char*)start_block + alloc_size) - 1;
 	footer->size_status = alloc_size;
 
+	// The one big free block is the only entry in the free lists
+	heap_base = space_ptr;
+	heap_size = alloc_size;
+	heap_used = 0;
+	initial_size = alloc_size + 2 * sizeof(block_header);
+	mapped_size = alloc_size + 2 * sizeof(block_header);
+	reserved_size = map_size;
+	memset(free_lists, 0, sizeof(free_lists));
+	memset(list_largest, 0, sizeof(list_largest));
+	free_index = (flags & MEM_TREE_INDEX) ? MEM_TREE_INDEX : MEM_LIST_INDEX;
+	tree_root = 0;
+	memset(&stats, 0, sizeof(stats));
+	Insert_Free_Block(start_block);
+
+	deferred = (flags & MEM_DEFERRED) ? TRUE : FALSE;
+	min_alloc_size = (flags & MEM_COMPACT) ? TINY_BLOCK_SIZE : MIN_BLOCK_SIZE;
+	thread_safe = (flags & MEM_THREAD_SAFE) ? TRUE : FALSE;
+	if (thread_safe && pthread_key_create(&thread_cache_key, Cache_Destroy) != 0) {
+		fprintf(stderr, "Error:mem.c: Cannot create the thread cache key\n");
+		return -1;
+	}
+
+	// A fork while another thread holds heap_lock would leave the child's
+	// copy locked forever, so the forking thread holds it across the fork
+	if (thread_safe && pthread_atfork(Lock_Heap, Unlock_Heap, Unlock_Heap) != 0) {
+		fprintf(stderr, "Error:mem.c: Cannot register the fork handlers\n");
+		return -1;
+	}
+
+	// One bit per slab frame of the whole range the heap may cover
+	if (flags & MEM_SLAB) {
+		slab_map = mmap(NULL, (map_size / SLAB_SIZE + 7) / 8, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (MAP_FAILED == slab_map) {
+			fprintf(stderr, "Error:mem.c: mmap cannot allocate the slab map\n");
+			slab_map = NULL;
+			return -1;
+		}
+	}
+
+	// One bit per page of the whole range the heap may cover
+	if (flags & MEM_GUARD) {
+		guard_size = pagesize;
+		guard_map = mmap(NULL, (map_size / pagesize + 7) / 8, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (MAP_FAILED == guard_map) {
+			fprintf(stderr, "Error:mem.c: mmap cannot allocate the guard map\n");
+			guard_map = NULL;
+			return -1;
+		}
+	}
+
+	// Check the heap every MEM_CHECK calls when it is set
+	const char *check = getenv("MEM_CHECK");
+	if (check != NULL)
+		check_interval = strtoul(check, NULL, 10);
+
+	// Record every call of the program to MEM_TRACE_FILE when it is set
+	init_region_size = sizeOfRegion;
+	init_flags = flags;
+	const char *trace_file = getenv("MEM_TRACE_FILE");
+	if (trace_file != NULL && strlen(trace_file) < sizeof(trace_path) &&
+		Trace_Mem_Start(0) == 0) {
+		strcpy(trace_path, trace_file);
+		atexit(Trace_Save_At_Exit);
+	}
+
+	return 0;
+}
+
+/*
+ * Function for rebuilding the free index of a heap found in a file, then
+ * checking all of it.
+ * Returns 0, or -1 after reporting the first broken invariant.
+ */
+static int Attach_Heap()
+{
+	block_header *block = start_block;
+
+	//only sizes are trusted before Check_Heap, the walk must stay in the heap
+	while ((BYTE*)block < END_OF_HEAP)
+	{
+		size_t size = GET_BLOCK_SIZE(block);
+		if (size % ALIGNMENT != 0 || size < MIN_BLOCK_SIZE || size > (size_t)(END_OF_HEAP - (BYTE*)block))
+			return Check_Fail(TO_OFFSET(block), "size is not a block size");
+		if (IS_ALLOCD(block))
+			heap_used += size;
+		else
+			Insert_Free_Block(block);
+		block = FIND_NEXT_BLOCK(block);
+	}
+	return Check_Heap();
+}
+
+/*
+ * Function used to initialize the memory allocator with a heap kept in a
+ * file, so that a later run of the program finds the same blocks and data.
+ * Intended to be called ONLY once by a program, instead of Init_Mem.
+ * Argument path: file holding the heap. It is created if missing.
+ * Argument sizeOfRegion: size of the heap made in an empty file, ignored
+ *   when the file already holds one.
+ * The heap has the default options and is mapped shared, so every change
+ * is in the file as soon as it is made. It is mapped at the same address as
+ * last time if possible, otherwise pointers kept inside it must be fixed
+ * up by the program, Get_Mem_Root always finds its data.
+ * A heap found in the file is checked like Check_Mem before it is used.
+ * Returns 0 on success.
+ * Returns -1 on failure, or if the file holds no heap or a corrupt one.
+ */
+int Init_Mem_File(const char *path, size_t sizeOfRegion) {
+	size_t pagesize = getpagesize();
+	file_header header;
+	struct stat st;
+
+	if (start_block != NULL) {
+		fprintf(stderr,
+			"Error:mem.c: Init_Mem has allocated space during a previous call\n");
+		return -1;
+	}
+
+	int fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (-1 == fd || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Error:mem.c: Cannot open %s\n", path);
+		if (-1 != fd)
+			close(fd);
+		return -1;
+	}
+
+	// An empty file gets a new heap, anything else must hold one
+	BOOL fresh = st.st_size == 0;
+	if (fresh) {
+		if (sizeOfRegion == 0) {
+			fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
+			close(fd);
+			return -1;
+		}
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+		header.version = FILE_VERSION;
+		header.word_size = sizeof(size_t);
+		header.heap_size = (sizeOfRegion + pagesize - 1) / pagesize * pagesize - 2 * sizeof(block_header);
+		if (ftruncate(fd, pagesize + header.heap_size + 2 * sizeof(block_header)) != 0) {
+			fprintf(stderr, "Error:mem.c: Cannot size %s\n", path);
+			close(fd);
+			return -1;
+		}
+	}
+	else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+		memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != FILE_VERSION || header.word_size != sizeof(size_t) ||
+		header.heap_size % ALIGNMENT != 0 ||
+		(uint64_t)st.st_size < pagesize + header.heap_size + 2 * sizeof(block_header)) {
+		fprintf(stderr, "Error:mem.c: %s doesn't hold a heap\n", path);
+		close(fd);
+		return -1;
+	}
+
+	// The same address as last time keeps pointers inside the heap valid
+	size_t map_size = pagesize + header.heap_size + 2 * sizeof(block_header);
+	BYTE *space_ptr = mmap((void*)(uintptr_t)header.base, map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == space_ptr) {
+		fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+		return -1;
+	}
+
+	heap_file = (file_header*)space_ptr;
+	heap_base = space_ptr + pagesize;
+	start_block = (block_header*)heap_base + 1;
+	heap_size = header.heap_size;
+	heap_used = 0;
+	initial_size = heap_size + 2 * sizeof(block_header);
+	mapped_size = initial_size;
+	reserved_size = initial_size;
+	page_size = pagesize;
+	memset(&stats, 0, sizeof(stats));
+
+	if (fresh) {
+		// One big free block, as in Init_Mem_Flags
+		*heap_file = header;
+		start_block->size_status = heap_size | P_BIT;
+		Set_Footer(start_block);
+		((block_header*)END_OF_HEAP)->size_status = A_BIT;
+		Insert_Free_Block(start_block);
+	}
+	else if (Attach_Heap() != 0) {
+		fprintf(stderr, "Error:mem.c: %s holds a corrupt heap\n", path);
+		munmap(space_ptr, map_size);
+		heap_file = NULL;
+		heap_base = NULL;
+		start_block = NULL;
+		heap_size = 0;
+		heap_used = 0;
+		memset(free_lists, 0, sizeof(free_lists));
+		memset(list_largest, 0, sizeof(list_largest));
+		memset(&stats, 0, sizeof(stats));
+		return -1;
+	}
+	heap_file->base = (uintptr_t)space_ptr;
+
+	// Check the heap every MEM_CHECK calls when it is set
+	const char *check = getenv("MEM_CHECK");
+	if (check != NULL)
+		check_interval = strtoul(check, NULL, 10);
+
+	return 0;
+}
+
+/*
+ * Function for remembering where the program's data in a heap file starts.
+ * Argument ptr: payload for Get_Mem_Root to return, NULL to clear it.
+ * It is kept as an offset in the file, so it survives the heap moving.
+ * Returns 0 on success.
+ * Returns -1 if the heap isn't from Init_Mem_File or ptr isn't in it.
+ */
+int Set_Mem_Root(void *ptr)
+{
+	if (heap_file == NULL || (ptr != NULL && ((BYTE*)ptr <= (BYTE*)start_block ||
+		(BYTE*)ptr >= END_OF_HEAP)))
+		return -1;
+	heap_file->root = ptr == NULL ? 0 : (BYTE*)ptr - heap_base;
 	return 0;
 }
 
+/*
+ * Function for finding the program's data in a heap file.
+ * Returns the payload last passed to Set_Mem_Root, in this run or an
+ * earlier one, or NULL if there is none.
+ */
+void* Get_Mem_Root()
+{
+	if (heap_file == NULL || heap_file->root == 0)
+		return NULL;
+	return heap_base + heap_file->root;
+}
+
 /*
  * Function to be used for DEBUGGING to help you visualize your heap structure.
  * Prints out a list of all the blocks including this information:
@@ -368,13 +3737,13 @@ void Dump_Mem() {
 	char p_status[5];
 	char *t_begin = NULL;
 	char *t_end = NULL;
-	int t_size;
+	size_t t_size;
 
 	block_header *current = start_block;
 	counter = 1;
 
-	int used_size = 0;
-	int free_size = 0;
+	size_t used_size = 0;
+	size_t free_size = 0;
 	int is_used = -1;
 
 	fprintf(stdout, "************************************Block list***\
@@ -383,7 +3752,7 @@ void Dump_Mem() {
 	fprintf(stdout, "-------------------------------------------------\
                     --------------------------------\n");
 
-	while (current->size_status != 1) {
+	while ((current->size_status & ALL_BUT_PA_BITS) != 0) {
 		t_begin = (char*)current;
 		t_size = current->size_status;
 
@@ -413,7 +3782,7 @@ void Dump_Mem() {
 
 		t_end = t_begin + t_size - 1;
 
-		fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%d\n", counter, status,
+		fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%zu\n", counter, status,
 			p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
 
 		current = (block_header*)((char*)current + t_size);
@@ -424,9 +3793,9 @@ void Dump_Mem() {
                     ------------------------------\n");
 	fprintf(stdout, "***************************************************\
                     ******************************\n");
-	fprintf(stdout, "Total used size = %d\n", used_size);
-	fprintf(stdout, "Total free size = %d\n", free_size);
-	fprintf(stdout, "Total size = %d\n", used_size + free_size);
+	fprintf(stdout, "Total used size = %zu\n", used_size);
+	fprintf(stdout, "Total free size = %zu\n", free_size);
+	fprintf(stdout, "Total size = %zu\n", used_size + free_size);
 	fprintf(stdout, "***************************************************\
                     ******************************\n");
 	fflush(stdout);
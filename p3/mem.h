@@ -1,14 +1,139 @@
 #ifndef __mem_h__
 #define __mem_h__
 
-int Init_Mem(int sizeOfRegion);
-void* Alloc_Mem(int size);
+#include <stddef.h>
+#include <stdint.h>
+
+/* Alignment of every payload: 8 bytes on 32-bit and 16 bytes on 64-bit */
+#define MEM_ALIGNMENT (2 * sizeof(size_t))
+
+/* Init_Mem_Flags options, or'd together */
+#define MEM_LIST_INDEX 0 // segregated free lists (default)
+#define MEM_TREE_INDEX 1 // size-ordered red-black tree of free blocks
+#define MEM_THREAD_SAFE 2 // locked heap with per-thread small block caches
+#define MEM_GROWABLE 4 // heap grows on demand and shrinks when its end is free
+#define MEM_SLAB 8 // small requests served from slabs of equal sized objects
+#define MEM_DEFERRED 16 // small freed blocks reused by exact size, coalesced lazily
+#define MEM_COMPACT 32 // requests of up to a word take two words instead of four
+#define MEM_GUARD 64 // large payloads end at an inaccessible guard page
+#define MEM_HUGE_PAGES 128 // heap backed by transparent huge pages
+#define MEM_HUGETLB 256 // heap taken from the reserved huge page pool
+
+// placement policies, see Set_Mem_Policy
+#define MEM_BEST_FIT 0  // smallest block that fits (the default)
+#define MEM_FIRST_FIT 1 // first block that fits, searching from the request's class
+#define MEM_NEXT_FIT 2  // first block that fits after where the last search stopped
+#define MEM_GOOD_FIT 3  // best of a bounded number of fits, or one close enough
+
+/* Number of block size classes: class k holds blocks of at least
+ * (4 * sizeof(size_t)) << k bytes and less than twice that, the last class
+ * also holds everything larger */
+#define MEM_NUM_CLASSES 32
+
+/* Heap statistics, see Mem_Stats */
+typedef struct mem_stats
+{
+	size_t heap_size;         // bytes in the heap, headers included
+	size_t used_bytes;        // bytes in allocated blocks, quick lists included
+	size_t free_bytes;        // bytes in free blocks
+	size_t largest_free;      // size of the largest free block
+	size_t free_blocks;       // number of free blocks
+	size_t allocs;            // successful allocations
+	size_t frees;             // successful frees
+	size_t reallocs;          // successful Realloc_Mem calls
+	size_t reallocs_in_place; // ... of which didn't move the block
+	size_t failed_allocs;     // allocations and reallocs that returned NULL
+	size_t splits;            // blocks split in two
+	size_t coalesces;         // neighboring blocks merged
+	size_t searches;          // free block searches
+	size_t search_steps;      // free blocks and tree nodes they looked at
+	size_t search_misses;     // searches that found no large enough block
+	size_t good_fit_limits;   // good-fit searches ended by the candidate limit
+	size_t good_fit_close;    // good-fit searches ended by a block within tolerance
+	size_t next_fit_wraps;    // next-fit searches that wrapped around
+	size_t slabs;             // slabs carved out of the heap
+	size_t slab_objects;      // live objects in them
+	size_t quick_frees;       // frees put on a quick list instead of coalescing
+	size_t quick_hits;        // allocations taken from a quick list, no search or split
+	size_t consolidations;    // times the quick lists were coalesced
+	size_t quick_blocks;      // blocks waiting on the quick lists
+	size_t quick_bytes;       // bytes in them
+	size_t mapped;            // live allocations in mappings of their own
+	size_t mapped_bytes;      // bytes mapped for them, outside heap_size
+	size_t handles;           // live handles from Handle_Alloc
+	size_t compact_moves;     // blocks moved by Compact_Mem
+	size_t compact_bytes;     // bytes in them
+	size_t page_size;         // size of the pages backing the heap
+	size_t free_by_class[MEM_NUM_CLASSES];  // free blocks per size class
+	size_t alloc_by_class[MEM_NUM_CLASSES]; // allocations per size class
+} mem_stats;
+
+/* Trace file format written by Trace_Mem_Save: a mem_trace_header followed by
+ * its records, oldest first. Offsets are payload addresses relative to the
+ * start of the heap mapping, 0 stands for NULL. */
+#define MEM_TRACE_MAGIC "MEMTRACE"
+#define MEM_TRACE_VERSION 1
+#define MEM_TRACE_RECORDS (1 << 20) // default ring size in records
+
+#define MEM_TRACE_ALLOC 1   // size requested, offset returned
+#define MEM_TRACE_FREE 2    // offset freed
+#define MEM_TRACE_REALLOC 3 // offset resized, the next record is the MEM_TRACE_ALLOC of the result
+#define MEM_TRACE_ALIGNED 4 // size is the alignment of the MEM_TRACE_ALLOC that follows
+
+typedef struct mem_trace_header
+{
+	char magic[8];      // MEM_TRACE_MAGIC without the terminating 0
+	uint32_t version;   // MEM_TRACE_VERSION
+	uint32_t flags;     // Init_Mem_Flags flags of the traced heap
+	uint64_t heap_size; // Init_Mem_Flags size of the traced heap
+	uint64_t records;   // records that follow
+	uint64_t dropped;   // older records overwritten in the ring
+} mem_trace_header;
+
+typedef struct mem_trace_record
+{
+	uint64_t time;   // nanoseconds since the recorder started
+	uint64_t offset; // payload offset returned or passed in
+	uint64_t size;   // requested size
+	uint32_t op;     // MEM_TRACE_ operation
+	uint32_t pad;
+} mem_trace_record;
+
+/* Movable block allocated with Handle_Alloc, 0 is never a valid handle */
+typedef size_t mem_handle;
+
+/* Arena of bump-allocated objects released all at once, see arena.c */
+typedef struct arena arena;
+
+int Init_Mem(size_t sizeOfRegion);
+int Init_Mem_Flags(size_t sizeOfRegion, int flags);
+int Init_Mem_File(const char *path, size_t sizeOfRegion);
+int Set_Mem_Root(void *ptr);
+void* Get_Mem_Root();
+void* Alloc_Mem(size_t size);
+void* Alloc_Mem_Aligned(size_t size, size_t alignment);
+void* Realloc_Mem(void *ptr, size_t size);
 int Free_Mem(void *ptr);
+size_t Size_Mem(void *ptr);
+int Set_Mem_Policy(int policy, size_t candidates, size_t tolerance);
+void Set_Mem_Map_Threshold(size_t threshold);
+int Set_Mem_Node(int node);
+void Mem_Stats(mem_stats *stats);
+int Check_Mem();
+mem_handle Handle_Alloc(size_t size);
+void* Handle_Lock(mem_handle handle);
+int Handle_Unlock(mem_handle handle);
+int Handle_Free(mem_handle handle);
+int Compact_Mem(size_t budget);
+int Trace_Mem_Start(size_t records);
+void Trace_Mem_Stop();
+long Trace_Mem_Save(const char *path);
 void Dump_Mem();
 
-void* malloc(size_t size) {
-    return NULL;
-}
+arena* Arena_Create(size_t chunk_size);
+void* Arena_Alloc(arena *a, size_t size);
+void Arena_Reset(arena *a);
+void Arena_Destroy(arena *a);
 
 #endif // __mem_h__
 
@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+// Main File:        replay.c
+// This File:        replay.c
+// Other Files:      mem.h, mem.c
+// Semester:         CS 354 Spring 2019
+//
+// Author:           Bryce Van Camp
+// Email:            bvancamp@wisc.edu
+// CS Login:         bvan-camp
+//
+/////////////////////////// OTHER SOURCES OF HELP //////////////////////////////
+//                   fully acknowledge and credit all sources of help,
+//                   other than Instructors and TAs.
+//
+// Persons:          none
+//
+// Online sources:   none
+//////////////////////////// 80 columns wide ///////////////////////////////////
+
+/*
+ * Replays a trace saved by Trace_Mem_Save against libmem.so and reports
+ *   throughput of the replayed calls,
+ *   peak heap usage,
+ *   external fragmentation (1 - largest free block / free bytes), as the
+ *   worst seen and at the end of the trace,
+ *   memory overhead per object when the most objects are live, the heap
+ *   bytes in use beyond what the live objects requested.
+ * The trace is replayed twice: once timed, then once calling Mem_Stats after
+ * every operation to measure usage. A trace of any program linked with
+ * libmem.so is recorded with
+ *   MEM_TRACE_FILE=program.trace program
+ * Usage: replay [-f flags] [-s heap_size] [-n repeat] [-p policy [-k K] [-t tolerance]] trace
+ * where policy is 0 best-fit, 1 first-fit, 2 next-fit or 3 good-fit, see
+ * Set_Mem_Policy for K and tolerance.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+
+/* A trace record with its offsets resolved to replay slots */
+typedef struct replay_op
+{
+	uint32_t op;        // MEM_TRACE_ALLOC, MEM_TRACE_FREE or MEM_TRACE_REALLOC
+	uint32_t slot;      // slot holding the pointer operated on
+	uint64_t size;      // requested size
+	uint64_t alignment; // alignment of an aligned allocation, 0 otherwise
+} replay_op;
+
+/* Open addressing map from traced offsets to slots */
+typedef struct slot_map
+{
+	uint64_t *keys;  // traced offsets, 0 for an empty entry
+	uint32_t *slots;
+	size_t mask;
+} slot_map;
+
+/*
+ * Function for finding the entry of offset in the map, or the empty entry
+ * where it would go.
+ */
+static size_t Map_Find(slot_map *map, uint64_t offset)
+{
+	size_t i = (offset * 0x9E3779B97F4A7C15ULL) >> 16 & map->mask;
+	while (map->keys[i] != 0 && map->keys[i] != offset)
+		i = (i + 1) & map->mask;
+	return i;
+}
+
+/*
+ * Function for removing the entry at i, moving later entries of its probe
+ * run back so that lookups never stop early.
+ */
+static void Map_Remove(slot_map *map, size_t i)
+{
+	size_t j = i;
+	map->keys[i] = 0;
+	while (1)
+	{
+		j = (j + 1) & map->mask;
+		if (map->keys[j] == 0)
+			return;
+		size_t home = (map->keys[j] * 0x9E3779B97F4A7C15ULL) >> 16 & map->mask;
+		//entry j may fill the hole at i if its home isn't within (i, j]
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+		{
+			map->keys[i] = map->keys[j];
+			map->slots[i] = map->slots[j];
+			map->keys[j] = 0;
+			i = j;
+		}
+	}
+}
+
+/*
+ * Function for reading a trace file and resolving its offsets to slots, so
+ * that the replay loop only indexes an array.
+ * Returns the number of operations, or -1 if the file can't be read.
+ */
+static long Load_Trace(const char *path, mem_trace_header *header,
+	replay_op **ops_out, size_t *slots_out)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1 || read(fd, header, sizeof(*header)) != sizeof(*header) ||
+		memcmp(header->magic, MEM_TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != MEM_TRACE_VERSION)
+	{
+		fprintf(stderr, "replay: %s is not a trace\n", path);
+		return -1;
+	}
+
+	size_t count = header->records;
+	mem_trace_record *records = malloc(count * sizeof(mem_trace_record) + 1);
+	replay_op *ops = malloc(count * sizeof(replay_op) + 1);
+	size_t bytes = count * sizeof(mem_trace_record);
+	if (records == NULL || ops == NULL || read(fd, records, bytes) != (ssize_t)bytes)
+	{
+		fprintf(stderr, "replay: %s is truncated\n", path);
+		return -1;
+	}
+	close(fd);
+
+	slot_map map;
+	map.mask = 1;
+	while (map.mask < 2 * count)
+		map.mask <<= 1;
+	map.keys = calloc(map.mask, sizeof(uint64_t));
+	map.slots = malloc(map.mask * sizeof(uint32_t));
+	map.mask--;
+
+	size_t n = 0;
+	uint32_t slots = 0;
+	for (size_t r = 0; r < count; r++)
+	{
+		mem_trace_record *record = &records[r];
+		replay_op *op = &ops[n];
+		op->op = record->op;
+		op->size = record->size;
+		op->alignment = 0;
+
+		//the call that owns a following MEM_TRACE_ALLOC record
+		mem_trace_record *result = NULL;
+		if ((record->op == MEM_TRACE_ALIGNED || record->op == MEM_TRACE_REALLOC) &&
+			r + 1 < count && records[r + 1].op == MEM_TRACE_ALLOC)
+			result = &records[++r];
+
+		switch (record->op)
+		{
+		case MEM_TRACE_ALIGNED:
+			if (result == NULL)
+				continue;
+			op->op = MEM_TRACE_ALLOC;
+			op->alignment = record->size;
+			op->size = result->size;
+			record = result;
+			//fall through
+		case MEM_TRACE_ALLOC:
+			op->slot = slots++;
+			if (record->offset != 0)
+			{
+				size_t i = Map_Find(&map, record->offset);
+				map.keys[i] = record->offset;
+				map.slots[i] = op->slot;
+			}
+			break;
+		case MEM_TRACE_FREE:
+		{
+			//frees of pointers the trace never handed out (e.g. its ring
+			//wrapped) are dropped
+			size_t i = Map_Find(&map, record->offset);
+			if (record->offset == 0 || map.keys[i] == 0)
+				continue;
+			op->slot = map.slots[i];
+			Map_Remove(&map, i);
+			break;
+		}
+		case MEM_TRACE_REALLOC:
+		{
+			if (result == NULL)
+				continue;
+			op->size = result->size;
+			size_t i = Map_Find(&map, record->offset);
+			if (record->offset != 0 && map.keys[i] == 0)
+				continue;
+			if (record->offset == 0)
+			{
+				op->slot = slots++;
+			}
+			else
+			{
+				op->slot = map.slots[i];
+				//a failed resize leaves the block where it was
+				if (result->offset == 0 && result->size != 0)
+					break;
+				Map_Remove(&map, i);
+			}
+			if (result->offset != 0)
+			{
+				i = Map_Find(&map, result->offset);
+				map.keys[i] = result->offset;
+				map.slots[i] = op->slot;
+			}
+			break;
+		}
+		default:
+			continue;
+		}
+		n++;
+	}
+
+	free(map.keys);
+	free(map.slots);
+	free(records);
+	*ops_out = ops;
+	*slots_out = slots;
+	return n;
+}
+
+/*
+ * Function for running one operation of the replay.
+ * Returns 1 if an allocation failed, 0 otherwise.
+ */
+static inline int Replay_Op(replay_op *op, void **ptrs)
+{
+	void **ptr = &ptrs[op->slot];
+
+	switch (op->op)
+	{
+	case MEM_TRACE_ALLOC:
+		*ptr = op->alignment != 0 ? Alloc_Mem_Aligned(op->size, op->alignment) : Alloc_Mem(op->size);
+		return *ptr == NULL;
+	case MEM_TRACE_FREE:
+		if (*ptr != NULL)
+			Free_Mem(*ptr);
+		*ptr = NULL;
+		return 0;
+	default:
+	{
+		void *new_ptr = Realloc_Mem(*ptr, op->size);
+		if (new_ptr == NULL && op->size != 0)
+			return 1;
+		*ptr = new_ptr;
+		return 0;
+	}
+	}
+}
+
+/*
+ * Function for freeing whatever the trace left allocated, so that the next
+ * pass starts from the empty heap again.
+ */
+static void Free_All(void **ptrs, size_t slots)
+{
+	for (size_t i = 0; i < slots; i++)
+	{
+		if (ptrs[i] != NULL)
+			Free_Mem(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+}
+
+/*
+ * Function for computing the external fragmentation of the heap.
+ */
+static double Fragmentation(mem_stats *stats)
+{
+	if (stats->free_bytes == 0)
+		return 0;
+	return 1.0 - (double)stats->largest_free / stats->free_bytes;
+}
+
+int main(int argc, char *argv[])
+{
+	int flags = -1;
+	size_t heap_size = 0;
+	int repeat = 1;
+	int policy = MEM_BEST_FIT;
+	size_t candidates = 0, tolerance = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:s:n:p:k:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f': flags = atoi(optarg); break;
+		case 's': heap_size = strtoul(optarg, NULL, 0); break;
+		case 'n': repeat = atoi(optarg); break;
+		case 'p': policy = atoi(optarg); break;
+		case 'k': candidates = strtoul(optarg, NULL, 0); break;
+		case 't': tolerance = strtoul(optarg, NULL, 0); break;
+		default:
+			repeat = 0;
+			break;
+		}
+	}
+	if (optind != argc - 1 || repeat < 1)
+	{
+		fprintf(stderr, "Usage: %s [-f flags] [-s heap_size] [-n repeat] "
+			"[-p policy [-k K] [-t tolerance]] trace\n", argv[0]);
+		return 1;
+	}
+
+	mem_trace_header header;
+	replay_op *ops;
+	size_t slots;
+	long count = Load_Trace(argv[optind], &header, &ops, &slots);
+	if (count < 0)
+		return 1;
+	if (flags < 0)
+		flags = header.flags;
+	if (heap_size == 0)
+		heap_size = header.heap_size;
+
+	void **ptrs = calloc(slots + 1, sizeof(void*));
+	if (ptrs == NULL || Init_Mem_Flags(heap_size, flags) != 0)
+		return 1;
+	if (Set_Mem_Policy(policy, candidates, tolerance) != 0)
+	{
+		fprintf(stderr, "replay: unknown policy %d\n", policy);
+		return 1;
+	}
+
+	//timed passes
+	struct timespec start, end;
+	long failed = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int pass = 0; pass < repeat; pass++)
+	{
+		for (long i = 0; i < count; i++)
+			failed += Replay_Op(&ops[i], ptrs);
+		Free_All(ptrs, slots);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	//search counters of the timed passes
+	mem_stats stats;
+	Mem_Stats(&stats);
+	mem_stats timed = stats;
+
+	//measured pass, sizes holds what each live slot requested
+	size_t *sizes = calloc(slots + 1, sizeof(size_t));
+	size_t peak_used = 0, peak_heap = 0;
+	size_t live_bytes = 0, live_objects = 0, peak_bytes = 0, peak_objects = 0, peak_objects_used = 0;
+	double worst_frag = 0;
+	for (long i = 0; i < count; i++)
+	{
+		uint32_t slot = ops[i].slot;
+		size_t old_size = ptrs[slot] != NULL ? sizes[slot] : 0;
+		size_t was_live = ptrs[slot] != NULL;
+		if (Replay_Op(&ops[i], ptrs) == 0 && ops[i].op != MEM_TRACE_FREE)
+			sizes[slot] = ops[i].size;
+		live_bytes += (ptrs[slot] != NULL ? sizes[slot] : 0) - old_size;
+		live_objects += (ptrs[slot] != NULL) - was_live;
+
+		Mem_Stats(&stats);
+		if (stats.used_bytes > peak_used) peak_used = stats.used_bytes;
+		if (live_objects > peak_objects)
+		{
+			peak_objects = live_objects;
+			peak_bytes = live_bytes;
+			peak_objects_used = stats.used_bytes;
+		}
+		if (stats.heap_size > peak_heap) peak_heap = stats.heap_size;
+		if (Fragmentation(&stats) > worst_frag) worst_frag = Fragmentation(&stats);
+	}
+	Mem_Stats(&stats);
+	double end_frag = Fragmentation(&stats);
+	Free_All(ptrs, slots);
+
+	printf("%s: %ld ops (%llu dropped), flags %d, heap %zu\n", argv[optind], count,
+		(unsigned long long)header.dropped, flags, heap_size);
+	printf("  throughput    %.0f ops/s (%d x %.6f s)\n",
+		seconds > 0 ? count * repeat / seconds : 0.0, repeat, seconds / repeat);
+	printf("  peak used     %zu of %zu bytes\n", peak_used, peak_heap);
+	printf("  fragmentation %.1f%% worst, %.1f%% at end\n", 100 * worst_frag, 100 * end_frag);
+	if (peak_objects != 0)
+		printf("  overhead      %.1f bytes per object, %.1f%% of %zu requested bytes in %zu objects\n",
+			(double)(peak_objects_used - peak_bytes) / peak_objects,
+			100.0 * (peak_objects_used - peak_bytes) / peak_bytes, peak_bytes, peak_objects);
+	printf("  failed allocs %ld\n", failed / repeat);
+	printf("  policy %d      %zu searches, %.2f steps each, %zu misses\n", policy,
+		timed.searches / repeat, timed.searches == 0 ? 0.0 : (double)timed.search_steps / timed.searches,
+		timed.search_misses / repeat);
+	printf("  splits        %zu, coalesces %zu", timed.splits / repeat, timed.coalesces / repeat);
+	if (flags & MEM_DEFERRED)
+		printf(", %zu quick hits, %zu consolidations", timed.quick_hits / repeat,
+			timed.consolidations / repeat);
+	printf("\n");
+	if (policy == MEM_GOOD_FIT)
+		printf("  good-fit      %zu cut by K, %zu within tolerance\n",
+			timed.good_fit_limits / repeat, timed.good_fit_close / repeat);
+	if (policy == MEM_NEXT_FIT)
+		printf("  next-fit      %zu wraps\n", timed.next_fit_wraps / repeat);
+
+	free(sizes);
+	free(ptrs);
+	free(ops);
+	return 0;
+}
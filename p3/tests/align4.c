@@ -0,0 +1,31 @@
+/* allocations with larger alignments, their usable sizes, and frees */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   void* ptr[4];
+
+   ptr[0] = Alloc_Mem_Aligned(10, 16);
+   ptr[1] = Alloc_Mem_Aligned(100, 64);
+   ptr[2] = Alloc_Mem_Aligned(1, 256);
+   ptr[3] = Alloc_Mem_Aligned(200, 1024);
+   assert(((unsigned long)ptr[0]) % 16 == 0);
+   assert(((unsigned long)ptr[1]) % 64 == 0);
+   assert(((unsigned long)ptr[2]) % 256 == 0);
+   assert(((unsigned long)ptr[3]) % 1024 == 0);
+
+   // usable sizes cover the request, plus rounding and an unsplit tail
+   assert(Size_Mem(ptr[0]) >= 10);
+   assert(Size_Mem(ptr[1]) >= 100 && Size_Mem(ptr[1]) < 100 + 4 * MEM_ALIGNMENT);
+   assert(Size_Mem(ptr[3]) >= 200 && Size_Mem(ptr[3]) < 200 + 4 * MEM_ALIGNMENT);
+   assert(Alloc_Mem_Aligned(8, 24) == NULL);
+
+   // the space around the aligned blocks was freed, so it all coalesces back
+   for (int i = 0; i < 4; i++)
+      assert(Free_Mem(ptr[i]) == 0);
+   assert(Size_Mem(NULL) == 0);
+   assert(Alloc_Mem(4000) != NULL);
+   exit(0);
+}
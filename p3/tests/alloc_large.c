@@ -0,0 +1,22 @@
+/* a growable 64-bit heap serves blocks larger than 2 GiB */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_GROWABLE) == 0);
+   if (sizeof(size_t) == 4)
+      exit(0);
+
+   size_t size = (size_t)3 << 30;
+   char* ptr = Alloc_Mem(size);
+   assert(ptr != NULL);
+   assert(((unsigned long)ptr) % MEM_ALIGNMENT == 0);
+   assert(Size_Mem(ptr) >= size);
+   ptr[0] = 1;
+   ptr[size - 1] = 1;
+
+   assert(Free_Mem(ptr) == 0);
+   assert(Alloc_Mem(16) != NULL);
+   exit(0);
+}
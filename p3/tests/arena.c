@@ -0,0 +1,63 @@
+/* arenas release a request's objects at once; compares the time of that
+ * with freeing each object, run with a round count to benchmark */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mem.h"
+
+#define OBJECTS 64
+
+static double now() {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+   int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+   assert(Init_Mem(1 << 20) == 0);
+   char* ptr[OBJECTS];
+
+   // per-object Free_Mem
+   double start = now();
+   for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < OBJECTS; i++) {
+         ptr[i] = Alloc_Mem(8 + (r + i) % 120);
+         assert(ptr[i] != NULL);
+         ptr[i][0] = i;
+      }
+      for (int i = 0; i < OBJECTS; i++)
+         assert(Free_Mem(ptr[i]) == 0);
+   }
+   double free_time = now() - start;
+
+   // one Arena_Reset per round
+   arena* a = Arena_Create(0);
+   assert(a != NULL);
+   start = now();
+   for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < OBJECTS; i++) {
+         ptr[i] = Arena_Alloc(a, 8 + (r + i) % 120);
+         assert(ptr[i] != NULL);
+         assert((unsigned long)ptr[i] % MEM_ALIGNMENT == 0);
+         ptr[i][0] = i;
+      }
+      for (int i = 0; i < OBJECTS; i++)
+         assert(ptr[i][0] == (char)i);
+      Arena_Reset(a);
+   }
+   double arena_time = now() - start;
+
+   // requests larger than a chunk get one of their own
+   assert(Arena_Alloc(a, 100 * 1024) != NULL);
+   assert(Arena_Alloc(a, 0) == NULL);
+   Arena_Destroy(a);
+
+   // everything went back to the heap
+   assert(Alloc_Mem((1 << 20) - 64) != NULL);
+
+   printf("%d rounds of %d objects: Free_Mem %.6f s, Arena_Reset %.6f s\n",
+          rounds, OBJECTS, free_time, arena_time);
+   exit(0);
+}
@@ -0,0 +1,36 @@
+/* Check for best fit implementation with the tree free block index */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_TREE_INDEX) == 0);
+   void* ptr[16];
+   void* test;
+
+   // free blocks of many distinct sizes, separated by allocated blocks
+   for (int i = 0; i < 16; i += 2) {
+      ptr[i] = Alloc_Mem(200 - i * 10);
+      assert(ptr[i] != NULL);
+      ptr[i + 1] = Alloc_Mem(8);
+      assert(ptr[i + 1] != NULL);
+   }
+   for (int i = 0; i < 16; i += 2)
+      assert(Free_Mem(ptr[i]) == 0);
+
+   // each request lands in the smallest free block that fits it
+   test = Alloc_Mem(120);
+   assert(test == ptr[8]);
+   test = Alloc_Mem(60);
+   assert(test == ptr[14]);
+   test = Alloc_Mem(60);
+   assert(test == ptr[12]);
+   test = Alloc_Mem(190);
+   assert(test == ptr[0]);
+
+   // freeing a neighbor coalesces and the merged block is found again
+   assert(Free_Mem(ptr[3]) == 0);
+   test = Alloc_Mem(180 + 8 + 160);
+   assert(test == ptr[2]);
+   exit(0);
+}
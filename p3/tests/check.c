@@ -0,0 +1,76 @@
+/* Check_Mem catches corrupt headers and footers, guard pages catch overruns */
+#include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(1 << 20, MEM_GUARD) == 0);
+   assert(Check_Mem() == 0);
+
+   void *ptr[4];
+   ptr[0] = Alloc_Mem(100);
+   ptr[1] = Alloc_Mem(200);
+   ptr[2] = Alloc_Mem(300);
+   ptr[3] = Alloc_Mem(64 * 1024);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL && ptr[3] != NULL);
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Check_Mem() == 0);
+
+   // a header whose size isn't a block size
+   size_t *header = (size_t*)ptr[2] - 1;
+   size_t saved = *header;
+   *header += 4;
+   assert(Check_Mem() == -1);
+   // a p-bit saying the free block before is allocated
+   *header = saved ^ 2;
+   assert(Check_Mem() == -1);
+   *header = saved;
+   // the footer of that free block
+   header[-1] += 2 * sizeof(size_t);
+   assert(Check_Mem() == -1);
+   header[-1] -= 2 * sizeof(size_t);
+   assert(Check_Mem() == 0);
+
+   // the large payload ends at a page that can't be touched
+   memset(ptr[3], 1, 64 * 1024);
+   assert(((uintptr_t)ptr[3] + 64 * 1024) % getpagesize() == 0);
+   pid_t pid = fork();
+   if (pid == 0) {
+      ((char*)ptr[3])[64 * 1024] = 1;
+      exit(0);
+   }
+   int status;
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+
+   // a guarded block moves when resized, and gets a guard page again
+   char *moved = Realloc_Mem(ptr[3], 100 * 1024);
+   assert(moved != NULL && moved != ptr[3]);
+   assert(moved[0] == 1 && moved[64 * 1024 - 1] == 1);
+   assert(((uintptr_t)moved + 100 * 1024) % getpagesize() == 0);
+   assert(Check_Mem() == 0);
+   assert(Free_Mem(moved) == 0);
+
+   // debug builds catch a write just past the payload
+   char *small = Alloc_Mem(21);
+   if (Size_Mem(small) == 21) {
+      small[21] = 0;
+      assert(Check_Mem() == -1);
+      assert(Free_Mem(small) == -1);
+      small[21] = (char)0xCA;
+   }
+   assert(Free_Mem(small) == 0);
+
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+   assert(Check_Mem() == 0);
+   mem_stats s;
+   Mem_Stats(&s);
+   assert(s.free_blocks == 1 && s.used_bytes == 0);
+   exit(0);
+}
@@ -0,0 +1,43 @@
+/* compact blocks hold a word in two words, and freed ones come back only
+ * through coalescing */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define N 64
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_COMPACT) == 0);
+   char* ptr[N];
+   mem_stats s;
+
+   for (int i = 0; i < N; i++) {
+      ptr[i] = Alloc_Mem(1 + i % sizeof(size_t));
+      assert(ptr[i] != NULL);
+      assert(Size_Mem(ptr[i]) == sizeof(size_t));
+      *(size_t*)ptr[i] = i;
+   }
+   for (int i = 1; i < N; i++)
+      assert(ptr[i] - ptr[i - 1] == MEM_ALIGNMENT);
+
+   // every other block freed: nothing can coalesce, and the tiny holes
+   // aren't handed out again
+   for (int i = 0; i < N; i += 2)
+      assert(Free_Mem(ptr[i]) == 0);
+   Mem_Stats(&s);
+   assert(s.free_blocks == N / 2 + 1);
+   assert(s.used_bytes == N / 2 * MEM_ALIGNMENT);
+   char* p = Alloc_Mem(1);
+   assert(p > ptr[N - 1]);
+   for (int i = 1; i < N; i += 2)
+      assert(*(size_t*)ptr[i] == i);
+
+   // freeing the rest merges the holes back into one block
+   for (int i = 1; i < N; i += 2)
+      assert(Free_Mem(ptr[i]) == 0);
+   assert(Free_Mem(p) == 0);
+   Mem_Stats(&s);
+   assert(s.free_blocks == 1 && s.used_bytes == 0);
+   assert(Alloc_Mem(4000) != NULL);
+   exit(0);
+}
@@ -0,0 +1,37 @@
+/* deferred coalescing reuses freed blocks by exact size and merges them
+ * only when a request doesn't fit otherwise */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_DEFERRED) == 0);
+   void* ptr[3];
+   mem_stats s;
+
+   ptr[0] = Alloc_Mem(100);
+   ptr[1] = Alloc_Mem(100);
+   ptr[2] = Alloc_Mem(100);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+
+   // the freed block neither merges nor gets split again
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Free_Mem(ptr[1]) == -1);
+   Mem_Stats(&s);
+   size_t splits = s.splits;
+   assert(s.quick_frees == 1 && s.quick_blocks == 1 && s.coalesces == 0);
+   assert(Alloc_Mem(100) == ptr[1]);
+   Mem_Stats(&s);
+   assert(s.quick_hits == 1 && s.splits == splits && s.quick_blocks == 0);
+
+   // a request only the merged blocks can serve coalesces the quick lists
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+   Mem_Stats(&s);
+   assert(s.coalesces == 0 && s.quick_blocks == 3);
+   assert(Alloc_Mem(4000) != NULL);
+   Mem_Stats(&s);
+   assert(s.consolidations == 1 && s.coalesces == 3 && s.quick_blocks == 0);
+   exit(0);
+}
@@ -0,0 +1,22 @@
+/* a payload that happens to hold the quick list key is still freed */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_DEFERRED) == 0);
+   mem_stats s;
+
+   size_t *ptr = Alloc_Mem(64);
+   assert(ptr != NULL);
+   ptr[0] = 0;
+   ptr[1] = 0x901C4E;
+   assert(Free_Mem(ptr) == 0);
+   Mem_Stats(&s);
+   assert(s.frees == 1 && s.quick_blocks == 1);
+
+   // a real double free is still caught
+   assert(Free_Mem(ptr) == -1);
+   assert(Check_Mem() == 0);
+   exit(0);
+}
@@ -0,0 +1,41 @@
+/* a growable heap grows past its initial size and gives its free end back */
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem_Flags(4096, MEM_GROWABLE) == 0);
+   char* ptr[1000];
+
+   // far more than the initial 4096 bytes
+   for (int i = 0; i < 1000; i++) {
+      ptr[i] = Alloc_Mem(1000);
+      assert(ptr[i] != NULL);
+      ptr[i][999] = i;
+   }
+   for (int i = 0; i < 1000; i++)
+      assert(ptr[i][999] == (char)i);
+
+   // a single request larger than any growth step
+   char* big = Alloc_Mem(3 << 20);
+   assert(big != NULL);
+   big[(3 << 20) - 1] = 1;
+
+   // freeing everything returns the pages at the end of the heap
+   assert(Free_Mem(big) == 0);
+   for (int i = 0; i < 1000; i++)
+      assert(Free_Mem(ptr[i]) == 0);
+   long pagesize = getpagesize();
+   unsigned char resident;
+   void* page = (void*)((unsigned long)ptr[999] & ~(pagesize - 1));
+   assert(mincore(page, pagesize, &resident) == 0);
+   assert((resident & 1) == 0);
+
+   // and the heap grows again after trimming
+   ptr[0] = Alloc_Mem(1 << 20);
+   assert(ptr[0] != NULL);
+   ptr[0][(1 << 20) - 1] = 1;
+   exit(0);
+}
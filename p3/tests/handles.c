@@ -0,0 +1,63 @@
+/* compaction slides unlocked handle blocks together so a big request fits again */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define N 120
+
+int main() {
+   assert(Init_Mem(64 * 1024) == 0);
+   mem_handle h[N];
+   mem_stats s;
+
+   for (int i = 0; i < N; i++) {
+      h[i] = Handle_Alloc(500);
+      assert(h[i] != 0);
+      char *p = Handle_Lock(h[i]);
+      memset(p, i, 500);
+      assert(Handle_Unlock(h[i]) == 0);
+   }
+   assert(Handle_Unlock(h[0]) == -1);
+
+   // every other block freed leaves holes too small for the big request
+   for (int i = 0; i < N; i += 2)
+      assert(Handle_Free(h[i]) == 0);
+   assert(Handle_Free(h[0]) == -1);
+   assert(Handle_Lock(h[0]) == NULL);
+   assert(Alloc_Mem(16 * 1024) == NULL);
+
+   // a locked block stays where it is
+   char *pinned = Handle_Lock(h[N - 1]);
+   assert(pinned != NULL);
+   assert(Handle_Free(h[N - 1]) == -1);
+
+   int steps = 0;
+   while (Compact_Mem(2048))
+      steps++;
+   assert(steps > 1);
+   assert(Handle_Lock(h[N - 1]) == pinned);
+   assert(Handle_Unlock(h[N - 1]) == 0 && Handle_Unlock(h[N - 1]) == 0);
+   assert(Check_Mem() == 0);
+
+   Mem_Stats(&s);
+   assert(s.handles == N / 2 && s.compact_moves > 0);
+   void *big = Alloc_Mem(16 * 1024);
+   assert(big != NULL);
+
+   for (int i = 1; i < N; i += 2) {
+      char *p = Handle_Lock(h[i]);
+      for (int k = 0; k < 500; k++)
+         assert(p[k] == i);
+      assert(Handle_Unlock(h[i]) == 0);
+      assert(Handle_Free(h[i]) == 0);
+   }
+   assert(Free_Mem(big) == 0);
+   assert(Check_Mem() == 0);
+
+   // freed entries are handed out again
+   mem_handle again = Handle_Alloc(100);
+   assert(again == h[N - 1]);
+   assert(Handle_Free(again) == 0);
+   exit(0);
+}
@@ -0,0 +1,34 @@
+/* a huge page backed heap works like any other, whatever pages it gets */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+int main() {
+   assert(Set_Mem_Node(0) == -1);
+   assert(Init_Mem_Flags(3 * 1024 * 1024, MEM_HUGE_PAGES) == 0);
+   mem_stats s;
+
+   // the kernel may have turned transparent huge pages off
+   Mem_Stats(&s);
+   assert(s.page_size == 2 * 1024 * 1024 || s.page_size == getpagesize());
+   assert(s.heap_size >= 3 * 1024 * 1024 - 64);
+
+   char *p = Alloc_Mem(2 * 1024 * 1024);
+   assert(p != NULL);
+   memset(p, 5, 2 * 1024 * 1024);
+   assert(Free_Mem(p) == 0);
+
+   // binding only fails where there is no such node
+   assert(Set_Mem_Node(-2) == -1);
+   if (Set_Mem_Node(0) == 0) {
+      p = Alloc_Mem(1024 * 1024);
+      assert(p != NULL);
+      memset(p, 6, 1024 * 1024);
+      assert(p[1024 * 1024 - 1] == 6);
+   }
+   assert(Set_Mem_Node(-1) == 0);
+   assert(Check_Mem() == 0);
+   exit(0);
+}
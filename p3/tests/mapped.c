@@ -0,0 +1,73 @@
+/* requests above the map threshold get their own mapping and leave the heap alone */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(64 * 1024) == 0);
+   mem_stats s;
+
+   // without a threshold everything comes from the heap
+   assert(Alloc_Mem(1024 * 1024) == NULL);
+
+   Set_Mem_Map_Threshold(32 * 1024);
+   char *big = Alloc_Mem(1024 * 1024);
+   assert(big != NULL && Size_Mem(big) >= 1024 * 1024);
+   memset(big, 7, 1024 * 1024);
+   Mem_Stats(&s);
+   assert(s.mapped == 1 && s.mapped_bytes > 1024 * 1024);
+   assert(s.used_bytes == 0 && s.free_blocks == 1);
+
+   // growing keeps the contents without going through the heap
+   big = Realloc_Mem(big, 8 * 1024 * 1024);
+   assert(big != NULL && Size_Mem(big) >= 8 * 1024 * 1024);
+   assert(big[0] == 7 && big[1024 * 1024 - 1] == 7);
+   big[8 * 1024 * 1024 - 1] = 1;
+   big = Realloc_Mem(big, 100);
+   assert(big != NULL && big[99] == 7);
+   Mem_Stats(&s);
+   assert(s.mapped == 1 && s.reallocs == 2 && s.used_bytes == 0);
+
+   // a heap block that outgrows the threshold moves to a mapping
+   char *small = Alloc_Mem(1000);
+   assert(small != NULL);
+   memset(small, 3, 1000);
+   small = Realloc_Mem(small, 40 * 1024);
+   assert(small != NULL && small[999] == 3);
+   Mem_Stats(&s);
+   assert(s.mapped == 2 && s.used_bytes == 0);
+
+   // a page that can't be read is never looked at, even with mappings live
+   char *none = mmap(NULL, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   assert(none != MAP_FAILED);
+   assert(Free_Mem(none + MEM_ALIGNMENT) == -1);
+   assert(Size_Mem(none + MEM_ALIGNMENT) == 0);
+   assert(Realloc_Mem(none + MEM_ALIGNMENT, 100) == NULL);
+   munmap(none, 4096);
+
+   // mappings freed out of order leave the others to be found
+   char *many[100];
+   for (int i = 0; i < 100; i++)
+      assert((many[i] = Alloc_Mem(40 * 1024)) != NULL);
+   for (int i = 0; i < 100; i++) {
+      assert(Free_Mem(many[i * 37 % 100]) == 0);
+      for (int j = i + 1; j < 100; j++)
+         assert(Size_Mem(many[j * 37 % 100]) >= 40 * 1024);
+   }
+   assert(Check_Mem() == 0);
+
+   assert(Free_Mem(big) == 0);
+   assert(Free_Mem(big) == -1);
+   assert(Free_Mem(small) == 0);
+   Mem_Stats(&s);
+   assert(s.mapped == 0 && s.mapped_bytes == 0);
+
+   // pointers from elsewhere are still turned down
+   void *other = malloc(64 * 1024);
+   assert(Free_Mem(other) == -1 && Size_Mem(other) == 0);
+   free(other);
+   assert(Check_Mem() == 0);
+   exit(0);
+}
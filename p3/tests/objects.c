@@ -0,0 +1,47 @@
+/* an object-heavy workload: many small objects of mixed sizes with some
+ * churn, mostly a fixture for measuring memory overhead per object */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define OBJECTS 20000
+#define ROUNDS 40000
+
+/* sizes skewed small like a service's objects: 1-8, 9-32, 33-128, 129-512 */
+static int object_size(unsigned int* seed) {
+   int r = rand_r(seed) % 10;
+   if (r < 4) return 1 + rand_r(seed) % 8;
+   if (r < 7) return 9 + rand_r(seed) % 24;
+   if (r < 9) return 33 + rand_r(seed) % 96;
+   return 129 + rand_r(seed) % 384;
+}
+
+int main() {
+   assert(Init_Mem(1 << 22) == 0);
+   static char* ptr[OBJECTS];
+   static int size[OBJECTS];
+   unsigned int seed = 354;
+
+   for (int i = 0; i < OBJECTS; i++) {
+      size[i] = object_size(&seed);
+      ptr[i] = Alloc_Mem(size[i]);
+      assert(ptr[i] != NULL);
+      memset(ptr[i], i, size[i]);
+   }
+
+   // replace random objects, each one still holds what was written into it
+   for (int r = 0; r < ROUNDS; r++) {
+      int i = rand_r(&seed) % OBJECTS;
+      assert(ptr[i][0] == (char)i && ptr[i][size[i] - 1] == (char)i);
+      assert(Free_Mem(ptr[i]) == 0);
+      size[i] = object_size(&seed);
+      ptr[i] = Alloc_Mem(size[i]);
+      assert(ptr[i] != NULL);
+      memset(ptr[i], i, size[i]);
+   }
+
+   for (int i = 0; i < OBJECTS; i++)
+      assert(Free_Mem(ptr[i]) == 0);
+   exit(0);
+}
@@ -0,0 +1,96 @@
+/* a heap kept in a file is found again, data and all, by the next process */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define PATH "persist.heap"
+#define BAD_PATH "persist_bad.heap"
+
+typedef struct node {
+   int value;
+   size_t next; // offset from the root, 0 ends the list
+} node;
+
+// runs part of the test in a fresh process, since a heap is set up only once
+static int Child(void (*part)()) {
+   int status;
+   pid_t pid = fork();
+   if (pid == 0) {
+      part();
+      exit(0);
+   }
+   waitpid(pid, &status, 0);
+   return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void Create() {
+   assert(Init_Mem_File(PATH, 64 * 1024) == 0);
+   assert(Get_Mem_Root() == NULL);
+   node *head = Alloc_Mem(sizeof(node));
+   assert(head != NULL && Set_Mem_Root(head) == 0);
+   head->value = 0;
+   head->next = 0;
+   for (int i = 1; i < 10; i++) {
+      node *n = Alloc_Mem(sizeof(node) + i * 100);
+      assert(n != NULL);
+      n->value = i;
+      n->next = head->next;
+      head->next = (char*)n - (char*)head;
+   }
+   assert(Free_Mem(Alloc_Mem(500)) == 0);
+}
+
+static void Attach() {
+   assert(Init_Mem_File(PATH, 0) == 0);
+   assert(Check_Mem() == 0);
+   node *head = Get_Mem_Root();
+   assert(head != NULL && head->value == 0);
+   int count = 0;
+   for (node *n = head; n->next != 0; n = (node*)((char*)head + n->next)) {
+      node *next = (node*)((char*)head + n->next);
+      assert(next->value == 9 - count);
+      assert(Size_Mem(next) >= sizeof(node) + next->value * 100);
+      count++;
+   }
+   assert(count == 9);
+   mem_stats s;
+   Mem_Stats(&s);
+   assert(s.used_bytes > 10 * sizeof(node) + 4500 && s.free_blocks == 1);
+}
+
+static void Attach_Corrupt() {
+   assert(Init_Mem_File(BAD_PATH, 0) == -1);
+}
+
+int main() {
+   unlink(PATH);
+   assert(Child(Create) == 0);
+   assert(Child(Attach) == 0);
+
+   // a broken block header is caught before the heap is used
+   char *file = malloc(getpagesize() + 64 * 1024);
+   int fd = open(PATH, O_RDONLY);
+   ssize_t size = read(fd, file, getpagesize() + 64 * 1024);
+   close(fd);
+   assert(size == getpagesize() + 64 * 1024);
+   ((size_t*)(file + getpagesize()))[1] += 2 * sizeof(size_t);
+   fd = open(BAD_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   assert(write(fd, file, size) == size);
+   close(fd);
+   assert(Child(Attach_Corrupt) == 0);
+
+   // so is a file that never held a heap
+   fd = open(BAD_PATH, O_WRONLY | O_TRUNC);
+   assert(write(fd, "not a heap", 10) == 10);
+   close(fd);
+   assert(Child(Attach_Corrupt) == 0);
+
+   unlink(PATH);
+   unlink(BAD_PATH);
+   free(file);
+   exit(0);
+}
@@ -0,0 +1,56 @@
+/* first-fit, next-fit and good-fit place blocks differently than best-fit */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   void* ptr[8];
+   void* p;
+   mem_stats s;
+
+   // free blocks, largest first on their list: 208, then 128 twice
+   for (int i = 0; i < 8; i++) {
+      ptr[i] = Alloc_Mem(i == 0 ? 200 : (i % 2 ? 40 : 120));
+      assert(ptr[i] != NULL);
+   }
+   assert(Free_Mem(ptr[6]) == 0);
+   assert(Free_Mem(ptr[4]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+   assert(Free_Mem(ptr[0]) == 0);
+
+   // first-fit takes the head
+   assert(Set_Mem_Policy(MEM_FIRST_FIT, 0, 0) == 0);
+   p = Alloc_Mem(100);
+   assert(p == ptr[0]);
+   assert(Free_Mem(p) == 0);
+
+   // best-fit skips the larger head of the list
+   assert(Set_Mem_Policy(MEM_BEST_FIT, 0, 0) == 0);
+   p = Alloc_Mem(100);
+   assert(p == ptr[2]);
+   assert(Free_Mem(p) == 0);
+
+   // next-fit moves on from the block it took last time
+   assert(Set_Mem_Policy(MEM_NEXT_FIT, 0, 0) == 0);
+   p = Alloc_Mem(100);
+   assert(Free_Mem(p) == 0);
+   assert(Alloc_Mem(100) != p);
+
+   // good-fit comparing one candidate is first-fit, a tolerance of a block
+   // size ends the search at once
+   assert(Set_Mem_Policy(MEM_GOOD_FIT, 1, 0) == 0);
+   assert(Set_Mem_Policy(MEM_GOOD_FIT + 1, 0, 0) == -1);
+   Mem_Stats(&s);
+   size_t limits = s.good_fit_limits;
+   p = Alloc_Mem(100);
+   Mem_Stats(&s);
+   assert(s.good_fit_limits == limits + 1);
+   assert(Free_Mem(p) == 0);
+   assert(Set_Mem_Policy(MEM_GOOD_FIT, 0, 4096) == 0);
+   p = Alloc_Mem(100);
+   Mem_Stats(&s);
+   assert(s.good_fit_close == 1);
+   assert(s.search_steps >= s.searches);
+   exit(0);
+}
@@ -0,0 +1,43 @@
+/* realloc shrinks and grows in place when it can and moves otherwise */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   char* ptr[3];
+
+   ptr[0] = Alloc_Mem(200);
+   ptr[1] = Alloc_Mem(200);
+   ptr[2] = Alloc_Mem(200);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+   for (int i = 0; i < 200; i++)
+      ptr[0][i] = i;
+
+   // shrinking splits off the tail in place
+   assert(Realloc_Mem(ptr[0], 100) == ptr[0]);
+   assert(Size_Mem(ptr[0]) < 200);
+
+   // growing into the tail that was just freed stays in place
+   assert(Realloc_Mem(ptr[0], 150) == ptr[0]);
+
+   // growing into a freed neighbor stays in place
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Realloc_Mem(ptr[0], 400) == ptr[0]);
+   for (int i = 0; i < 100; i++)
+      assert(ptr[0][i] == (char)i);
+
+   // no room after the block, so it moves and keeps its contents
+   char* moved = Realloc_Mem(ptr[0], 1000);
+   assert(moved != NULL && moved != ptr[0]);
+   for (int i = 0; i < 100; i++)
+      assert(moved[i] == (char)i);
+
+   // a request that can't be met leaves the block as it was
+   assert(Realloc_Mem(moved, 4000) == NULL);
+   assert(moved[99] == 99);
+
+   assert(Realloc_Mem(NULL, 8) != NULL);
+   assert(Realloc_Mem(moved, 0) == NULL);
+   exit(0);
+}
@@ -0,0 +1,53 @@
+/* small requests come from slabs, which go back to the heap when empty */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define N 1000
+
+int main() {
+   assert(Init_Mem_Flags(1 << 20, MEM_SLAB) == 0);
+   char* ptr[N];
+   mem_stats s;
+
+   for (int i = 0; i < N; i++) {
+      int size = 8 + i % 249;
+      ptr[i] = Alloc_Mem(size);
+      assert(ptr[i] != NULL);
+      assert((unsigned long)ptr[i] % MEM_ALIGNMENT == 0);
+      assert(Size_Mem(ptr[i]) >= size && Size_Mem(ptr[i]) < size + MEM_ALIGNMENT);
+      memset(ptr[i], i, size);
+   }
+   Mem_Stats(&s);
+   assert(s.slabs > 0 && s.slab_objects == N);
+
+   // neighbors in a slab share no headers, so nothing was overwritten
+   for (int i = 0; i < N; i++)
+      assert(ptr[i][0] == (char)i && ptr[i][7] == (char)i);
+
+   // a freed object is handed out again, a second free fails
+   char* p = ptr[5];
+   assert(Free_Mem(p) == 0);
+   assert(Free_Mem(p) == -1);
+   assert(Size_Mem(p) == 0 && Size_Mem(p + 1) == 0);
+   ptr[5] = Alloc_Mem(8 + 5 % 249);
+   assert(ptr[5] == p);
+
+   // growing out of the class moves, shrinking stays
+   ptr[0] = Realloc_Mem(ptr[0], 4);
+   assert(ptr[0] != NULL && ptr[0][0] == 0);
+   ptr[1] = Realloc_Mem(ptr[1], 1000);
+   assert(ptr[1] != NULL && ptr[1][7] == 1);
+
+   for (int i = 0; i < N; i++)
+      assert(Free_Mem(ptr[i]) == 0);
+   Mem_Stats(&s);
+   assert(s.slab_objects == 0);
+   // at most one empty slab stays per class
+   assert(s.slabs <= 256 / MEM_ALIGNMENT);
+
+   // large requests still come from the boundary-tag heap
+   assert(Alloc_Mem(512 * 1024) != NULL);
+   exit(0);
+}
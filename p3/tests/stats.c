@@ -0,0 +1,62 @@
+/* statistics track allocations, splits, coalesces and free space */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   mem_stats s;
+   void* ptr[3];
+
+   Mem_Stats(&s);
+   assert(s.allocs == 0 && s.frees == 0);
+   assert(s.free_blocks == 1);
+   assert(s.free_bytes == s.heap_size - s.used_bytes);
+   assert(s.largest_free == s.free_bytes);
+
+   ptr[0] = Alloc_Mem(100);
+   ptr[1] = Alloc_Mem(100);
+   ptr[2] = Alloc_Mem(100);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+   assert(Alloc_Mem(8192) == NULL);
+
+   Mem_Stats(&s);
+   assert(s.allocs == 3 && s.failed_allocs == 1);
+   assert(s.splits == 3);
+   assert(s.free_blocks == 1);
+   assert(s.free_bytes == s.heap_size - s.used_bytes);
+
+   // freeing the middle block leaves two free blocks, then both merge
+   assert(Free_Mem(ptr[1]) == 0);
+   Mem_Stats(&s);
+   assert(s.frees == 1 && s.free_blocks == 2 && s.coalesces == 0);
+   assert(s.largest_free < s.free_bytes);
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+
+   Mem_Stats(&s);
+   assert(s.frees == 3 && s.free_blocks == 1);
+   assert(s.coalesces == 3);
+   assert(s.largest_free == s.free_bytes);
+
+   size_t by_class = 0;
+   for (int i = 0; i < MEM_NUM_CLASSES; i++)
+      by_class += s.alloc_by_class[i];
+   assert(by_class == s.allocs);
+
+   // taking the largest block of a list leaves the next largest on it
+   void* a = Alloc_Mem(400);
+   assert(a != NULL && Alloc_Mem(100) != NULL);
+   void* c = Alloc_Mem(300);
+   assert(c != NULL && Alloc_Mem(100) != NULL);
+   Mem_Stats(&s);
+   assert(Alloc_Mem(s.largest_free - sizeof(size_t)) != NULL);
+   assert(Free_Mem(a) == 0 && Free_Mem(c) == 0);
+   Mem_Stats(&s);
+   assert(s.free_blocks == 2 && s.largest_free > s.free_bytes - s.largest_free);
+   assert(Alloc_Mem(400) == a);
+   Mem_Stats(&s);
+   assert(s.free_blocks == 1 && s.largest_free == s.free_bytes);
+   assert(Check_Mem() == 0);
+   exit(0);
+}
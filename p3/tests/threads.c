@@ -0,0 +1,73 @@
+/* many threads allocating, writing and freeing at once, including frees of
+ * blocks allocated by another thread */
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mem.h"
+
+#define THREADS 8
+#define SLOTS 256
+#define ROUNDS 20000
+
+static void* shared[THREADS];
+
+static void* worker(void* arg) {
+   int id = (int)(long)arg;
+   unsigned int seed = id;
+   unsigned char* ptr[SLOTS] = {0};
+   int size[SLOTS];
+
+   for (int i = 0; i < ROUNDS; i++) {
+      int j = rand_r(&seed) % SLOTS;
+      if (ptr[j] != NULL) {
+         // the block still holds what this thread wrote into it
+         for (int k = 0; k < size[j]; k++)
+            assert(ptr[j][k] == (unsigned char)(id + j + k));
+         assert(Free_Mem(ptr[j]) == 0);
+         ptr[j] = NULL;
+      } else {
+         size[j] = 1 + rand_r(&seed) % (j % 8 == 0 ? 1000 : 100);
+         ptr[j] = Alloc_Mem(size[j]);
+         assert(ptr[j] != NULL);
+         for (int k = 0; k < size[j]; k++)
+            ptr[j][k] = id + j + k;
+      }
+
+      // hand a block to the next thread and free whatever was handed over
+      if (i % 64 == 0) {
+         void* mine = Alloc_Mem(32);
+         assert(mine != NULL);
+         void* theirs = __sync_lock_test_and_set(&shared[(id + 1) % THREADS], mine);
+         if (theirs != NULL)
+            assert(Free_Mem(theirs) == 0);
+      }
+   }
+
+   for (int j = 0; j < SLOTS; j++)
+      if (ptr[j] != NULL)
+         assert(Free_Mem(ptr[j]) == 0);
+   return NULL;
+}
+
+static void* cleanup(void* arg) {
+   for (int i = 0; i < THREADS; i++)
+      if (shared[i] != NULL)
+         assert(Free_Mem(shared[i]) == 0);
+   return NULL;
+}
+
+int main() {
+   assert(Init_Mem_Flags(1 << 22, MEM_THREAD_SAFE) == 0);
+   pthread_t threads[THREADS];
+
+   for (long i = 0; i < THREADS; i++)
+      assert(pthread_create(&threads[i], NULL, worker, (void*)i) == 0);
+   for (int i = 0; i < THREADS; i++)
+      assert(pthread_join(threads[i], NULL) == 0);
+   assert(pthread_create(&threads[0], NULL, cleanup, NULL) == 0);
+   assert(pthread_join(threads[0], NULL) == 0);
+
+   // every thread's cache went back to the heap, so it is one free block again
+   assert(Alloc_Mem((1 << 22) - 64) != NULL);
+   exit(0);
+}
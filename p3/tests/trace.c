@@ -0,0 +1,90 @@
+/* a trace of many threads reuses an address only after the record freeing it,
+ * also across a restart of the recorder while they run */
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define PATH "trace_saved.trace"
+#define HEAP (1 << 22)
+#define THREADS 4
+#define SLOTS 16
+#define ROUNDS 40000
+
+static void* worker(void* arg) {
+   unsigned int seed = (int)(long)arg;
+   void* ptr[SLOTS] = {0};
+
+   // blocks too big for the thread caches go straight back to the heap
+   for (int i = 0; i < ROUNDS; i++) {
+      int j = rand_r(&seed) % SLOTS;
+      if (ptr[j] == NULL) {
+         ptr[j] = Alloc_Mem(2000 + rand_r(&seed) % 2000);
+      } else if (rand_r(&seed) % 4 == 0) {
+         void* moved = Realloc_Mem(ptr[j], 2000 + rand_r(&seed) % 4000);
+         if (moved != NULL)
+            ptr[j] = moved;
+      } else {
+         assert(Free_Mem(ptr[j]) == 0);
+         ptr[j] = NULL;
+      }
+   }
+
+   for (int j = 0; j < SLOTS; j++)
+      if (ptr[j] != NULL)
+         assert(Free_Mem(ptr[j]) == 0);
+   return NULL;
+}
+
+int main() {
+   assert(Init_Mem_Flags(HEAP, MEM_THREAD_SAFE) == 0);
+   assert(Trace_Mem_Start(0) == 0);
+
+   pthread_t threads[THREADS];
+   for (int i = 0; i < THREADS; i++)
+      assert(pthread_create(&threads[i], NULL, worker, (void*)(long)i) == 0);
+   // a new ring while the threads record into the old one
+   usleep(1000);
+   assert(Trace_Mem_Start(0) == 0);
+   for (int i = 0; i < THREADS; i++)
+      assert(pthread_join(threads[i], NULL) == 0);
+   Trace_Mem_Stop();
+   assert(Trace_Mem_Save(PATH) > 0);
+
+   mem_trace_header header;
+   int fd = open(PATH, O_RDONLY);
+   assert(read(fd, &header, sizeof(header)) == sizeof(header));
+   assert(header.dropped == 0);
+   mem_trace_record* records = malloc(header.records * sizeof(mem_trace_record));
+   size_t bytes = header.records * sizeof(mem_trace_record);
+   assert(read(fd, records, bytes) == (ssize_t)bytes);
+   close(fd);
+   unlink(PATH);
+
+   // blocks allocated before the restart are unknown, so only an address
+   // handed out again while the trace still holds it live is wrong
+   char* live = calloc(2 * HEAP / MEM_ALIGNMENT, 1);
+   for (size_t r = 0; r < header.records; r++) {
+      mem_trace_record* record = &records[r];
+      size_t slot = record->offset / MEM_ALIGNMENT;
+      if (record->op == MEM_TRACE_ALLOC && record->offset != 0) {
+         assert(!live[slot]);
+         live[slot] = 1;
+      } else if (record->op == MEM_TRACE_FREE) {
+         live[slot] = 0;
+      } else if (record->op == MEM_TRACE_REALLOC) {
+         mem_trace_record* result = &records[++r];
+         assert(result->op == MEM_TRACE_ALLOC);
+         if (result->offset == 0)
+            continue;
+         live[slot] = 0;
+         assert(!live[result->offset / MEM_ALIGNMENT]);
+         live[result->offset / MEM_ALIGNMENT] = 1;
+      }
+   }
+   free(live);
+   free(records);
+   exit(0);
+}
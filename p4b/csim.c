@@ -29,12 +29,17 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <immintrin.h>
 
 /****************************************************************************/
 /***** DO NOT MODIFY THESE VARIABLE NAMES ***********************************/
 
 /* Globals set by command line args */
-int s = 0;         /* set index bits */
+int s = -1;        /* set index bits */
 int E = 0;         /* associativity */
 int b = 0;         /* block offset bits */
 int verbosity = 0; /* print trace if set */
@@ -58,64 +63,167 @@ int t = 0;
  */
 typedef unsigned long long int mem_addr_t;
 
-/* Type: Cache line
- * Use this type for each line of the cache
+/* Type: Cache
+ * The whole cache is one contiguous, set-major array of tags: the E lines of
+ * set i are tags[i * E] to tags[i * E + E - 1], so looking up a set scans
+ * adjacent memory. ages runs parallel to tags and holds the value of
+ * access_clock at each line's last access, 0 for an invalid line, so the
+ * least recently used line of a set is the one with the smallest age. An
+ * invalid line's tag is INVALID_TAG, which no address can produce since b is
+ * at least 1.
  */
-typedef struct cache_line {
-  char valid;
-  mem_addr_t tag;
-  struct cache_line* next;
-} cache_line_t;
+typedef struct cache {
+  mem_addr_t* tags;
+  unsigned long long* ages;
+} cache_t;
 
-typedef cache_line_t* cache_set_t;
-typedef cache_set_t* cache_t;
+#define INVALID_TAG (~(mem_addr_t)0)
 
 /* The cache we are simulating */
 cache_t cache;
 
+/* Number of accesses so far, the age of the line accessed last */
+unsigned long long access_clock = 0;
+
+/* Type: Tag search kernel
+ * Returns the way of the set starting at tags whose tag is tagID, -1 if
+ * none of its E lines has it.
+ */
+typedef int (*find_line_t)(const mem_addr_t* tags, mem_addr_t tagID);
+
+/*
+ * find_line_scalar - compares the tags one at a time
+ */
+int find_line_scalar(const mem_addr_t* tags, mem_addr_t tagID) {
+  for (int i = 0; i < E; i++) {
+    if (tags[i] == tagID) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * find_line_sse4 - compares two tags per instruction, turning each result
+ * into a mask whose lowest set bit is the hit way
+ */
+__attribute__((target("sse4.1")))
+int find_line_sse4(const mem_addr_t* tags, mem_addr_t tagID) {
+  __m128i probe = _mm_set1_epi64x(tagID);
+  int i = 0;
+  for (; i + 2 <= E; i += 2) {
+    __m128i ways = _mm_loadu_si128((const __m128i*)(tags + i));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(ways, probe)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  // an odd last way
+  return i < E && tags[i] == tagID ? i : -1;
+}
+
+/*
+ * find_line_avx2 - compares four tags per instruction, eight per loop
+ */
+__attribute__((target("avx2")))
+int find_line_avx2(const mem_addr_t* tags, mem_addr_t tagID) {
+  __m256i probe = _mm256_set1_epi64x(tagID);
+  int i = 0;
+  for (; i + 8 <= E; i += 8) {
+    __m256i lo = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256((const __m256i*)(tags + i)), probe);
+    __m256i hi = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256((const __m256i*)(tags + i + 4)), probe);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+               _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  for (; i + 4 <= E; i += 4) {
+    __m256i ways = _mm256_loadu_si256((const __m256i*)(tags + i));
+    int mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(ways, probe)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  for (; i < E; i++) {
+    if (tags[i] == tagID) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* The kernels in order of preference, the last one runs anywhere */
+struct kernel {
+  const char* name;
+  const char* feature;  /* CPU feature it needs, NULL for none */
+  find_line_t find;
+} kernels[] = {
+  { "avx2", "avx2", find_line_avx2 },
+  { "sse4", "sse4.1", find_line_sse4 },
+  { "scalar", NULL, find_line_scalar },
+};
+
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+/* The kernel access_data uses, chosen by select_kernel */
+find_line_t find_line = find_line_scalar;
+
+/*
+ * kernel_supported - whether the CPU we run on has what kernel k needs,
+ * once main has called __builtin_cpu_init
+ */
+bool kernel_supported(int k) {
+  // __builtin_cpu_supports needs a string literal
+  if (kernels[k].feature == NULL) return true;
+  if (strcmp(kernels[k].feature, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+  return __builtin_cpu_supports("sse4.1");
+}
+
+/*
+ * select_kernel - makes find_line the kernel named name, or the best one
+ * the CPU supports if name is NULL. Exits if the named one can't run here.
+ */
+void select_kernel(const char* name) {
+  for (int k = 0; k < NUM_KERNELS; k++) {
+    if (name != NULL && strcmp(name, kernels[k].name) != 0) continue;
+    if (kernel_supported(k)) {
+      find_line = kernels[k].find;
+      return;
+    }
+    if (name != NULL) break;
+  }
+  printf("tag search kernel %s is not supported here\n", name);
+  exit(1);
+}
+
 /*
  * init_cache -
  * Allocate data structures to hold info regrading the sets and cache lines
- * use struct "cache_line_t" here
- * Initialize valid and tag field with 0s.
+ * Initialize every line as invalid.
  * use S (= 2^s) and E while allocating the data structures here
  */
 void init_cache() {
   // set values for num sets, num bytes/block, and tag bits
-  S = 2 << s;
-  B = 2 << b;
+  S = 1 << s;
+  B = 1 << b;
   t = (sizeof(mem_addr_t) * 8) - s - b;
 
-  // allocate cache with num sets S
-  cache = malloc(sizeof(cache_set_t) * S);
-  if (cache == NULL) {
+  // allocate the tags and ages of all S * E lines in one piece each
+  size_t lines = (size_t)S * E;
+  cache.tags = malloc(sizeof(mem_addr_t) * lines);
+  cache.ages = calloc(lines, sizeof(unsigned long long));
+  if (cache.tags == NULL || cache.ages == NULL) {
     printf("error allocating memory to cache\n");
     exit(1);
   }
-  // allocate each set of the cache with num lines E
-  for (int i = 0; i < S; i++) {
-    // allocate head node of set i and set fields to 0
-    cache[i] = malloc(sizeof(cache_line_t));
-    if (cache[i] == NULL) {
-      printf("error allocating first line of set #%i in the cache", i);
-      exit(1);
-    }
-    cache[i]->valid = 0;
-    cache[i]->tag = 0;
-
-    // allocate next nodes of set i and set fields to 0
-    cache_line_t* curNode = cache[i];
-    for (int j = 1; j < E; j++) {
-      curNode->next = malloc(sizeof(cache_line_t));
-      if (curNode->next == NULL) {
-        printf("error allocating line %i of set #%i in the cache", j, i);
-      }
-      curNode->next->valid = 0;
-      curNode->next->tag = 0;
-      curNode = curNode->next;
-    }
-    // set tail node's next to NULL to avoid undefined behavior
-    curNode->next = NULL;
+  for (size_t i = 0; i < lines; i++) {
+    cache.tags[i] = INVALID_TAG;
   }
 }
 
@@ -123,40 +231,10 @@ void init_cache() {
  * inside init_cache() function
  */
 void free_cache() {
-  // free each set of the cache first
-  for (int i = 0; i < S; i++) {
-    cache_line_t* curNode = cache[i];
-    // free all but the last node of the linked list
-    while (curNode->next != NULL) {
-      cache_line_t* nodeToDelete = curNode;
-      curNode = curNode->next;
-      free(nodeToDelete);
-    }
-    // free the last node in the list
-    free(curNode);
-  }
-  // free the cache and set to NULL
-  free(cache);
-  cache = NULL;
-}
-
-/*
- * This function brings the node accessed by access_data to the front,
- * which makes it the head of the linked list.
- * param - curSet     this is the current set that was extracted from addr in
- * access_data
- * param - parentNode this is the parent of the node that we will make the head
- * of the list
- */
-void bringNodeToFront(mem_addr_t curSet, cache_line_t* parentNode) {
-  // set value of node that we will move
-  cache_line_t* node = parentNode->next;
-  // update parent node's child
-  parentNode->next = node->next;
-  // make node point to the old head
-  node->next = cache[curSet];
-  // move node to the front of the list
-  cache[curSet] = node;
+  free(cache.tags);
+  free(cache.ages);
+  cache.tags = NULL;
+  cache.ages = NULL;
 }
 
 /*
@@ -167,95 +245,219 @@ void bringNodeToFront(mem_addr_t curSet, cache_line_t* parentNode) {
  *   you will manipulate data structures allocated in init_cache() here
  */
 void access_data(mem_addr_t addr) {
-  // initialize variables regarding the current set and tag value of param addr
-  mem_addr_t curSet = addr << t;
-  curSet >>= (t + b);
+  // find the lines of the set addr maps to
+  mem_addr_t curSet = (addr >> b) & (S - 1);
   mem_addr_t tagID = addr >> (s + b);
+  mem_addr_t* tags = cache.tags + curSet * E;
+  unsigned long long* ages = cache.ages + curSet * E;
+  access_clock++;
+
+  // look for a hit, comparing nothing but tags
+  int way = find_line(tags, tagID);
+  if (way >= 0) {
+    hit_cnt++;
+    ages[way] = access_clock;
+    return;
+  }
 
-  // check if direct-mapped cache
-  if (E == 1) {
-    // if v-bit is 1, there is an item already in the block
-    if (cache[curSet]->valid) {
-      // if tags match, it's a cache hit; increment hit_cnt
-      if (tagID == cache[curSet]->tag) {
-        hit_cnt++;
-      } else {  // else there was a conflict miss
-        // set tag id and v-bit
-        cache[curSet]->tag = tagID;
-        cache[curSet]->valid = 1;
-
-        // increment miss_cnt and evict_cnt
-        miss_cnt++;
-        evict_cnt++;
-      }
-    } else {  // else v-bit is 0, i.e. no item in the block; this is a cold miss
-      // set tag id and v-bit
-      cache[curSet]->tag = tagID;
-      cache[curSet]->valid = 1;
+  // on a miss replace the least recently used line, invalid lines being the
+  // oldest
+  int victim = 0;
+  for (int i = 1; i < E; i++) {
+    if (ages[i] < ages[victim]) {
+      victim = i;
+    }
+  }
 
-      // increment miss_cnt
-      miss_cnt++;
+  // increment evict_cnt if the line replaced was valid
+  if (ages[victim] != 0) {
+    evict_cnt++;
+  }
+  miss_cnt++;
+  tags[victim] = tagID;
+  ages[victim] = access_clock;
+}
+
+/*
+ * Binary trace format, written by convert_trace. It starts with TRACE_MAGIC
+ * and holds one record per data access, instruction loads are left out. A
+ * record is a byte with the type of access in its low 2 bits (0 L, 1 S,
+ * 2 M) and the size in the other 6, or BIG_SIZE if a varint with the size
+ * follows, then the address as a zigzag varint of its difference from the
+ * previous address. Varints hold 7 bits per byte, lowest first, with the top
+ * bit set on every byte but the last. Most records take 2 to 4 bytes.
+ */
+#define TRACE_MAGIC "CSIMBIN1"
+#define TRACE_MAGIC_SIZE 8
+#define BIG_SIZE 63
+
+/* Type: Trace
+ * A trace file mapped into memory and decoded in place by next_access,
+ * without copying lines out of it. The format is detected from the first
+ * bytes.
+ */
+typedef struct trace {
+  const char* data;  /* first byte of the file, NULL if it is empty */
+  const char* pos;   /* start of the next line or record to decode */
+  const char* end;   /* one past the last byte */
+  bool binary;       /* whether it holds records instead of text */
+  mem_addr_t last;   /* address of the last record decoded */
+} trace_t;
+
+/*
+ * open_trace - maps the given trace file for reading
+ */
+void open_trace(char* trace_fn, trace_t* trace) {
+  struct stat st;
+  int fd = open(trace_fn, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+    exit(1);
+  }
+  // an empty file can't be mapped and has nothing to decode anyway
+  trace->data = NULL;
+  if (st.st_size > 0) {
+    trace->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->data == MAP_FAILED) {
+      fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+      exit(1);
     }
-  } else {  // else not a direct-mapped cache, i.e. lines/set > 1
-    // set line ptrs that refer to the parent of the current line, along with
-    // the parent's parent
-    cache_line_t* parentLine = NULL;
-    cache_line_t* parentOfParentLine = NULL;
-
-    // go through curSet until parentLine is the parent of the tail node
-    for (parentLine = cache[curSet]; parentLine->next->next != NULL;
-         parentLine = parentLine->next) {
-      // if tags match and v-bit is 1, increment hit_cnt
-      if (tagID == parentLine->tag && parentLine->valid) {
-        hit_cnt++;
-        // if parentLine isn't the head already, bring it to the front of the
-        // list
-        if (parentLine != cache[curSet]) {
-          bringNodeToFront(curSet, parentOfParentLine);
-        }
-        return;
-      }
+    madvise((void*)trace->data, st.st_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  trace->pos = trace->data;
+  trace->end = trace->data + st.st_size;
+  trace->last = 0;
+  trace->binary = st.st_size >= TRACE_MAGIC_SIZE &&
+                  memcmp(trace->data, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0;
+  if (trace->binary) {
+    trace->pos += TRACE_MAGIC_SIZE;
+  }
+}
 
-      parentOfParentLine = parentLine;
+/*
+ * rewind_trace - goes back to the first access of a trace
+ */
+void rewind_trace(trace_t* trace) {
+  trace->pos = trace->data + (trace->binary ? TRACE_MAGIC_SIZE : 0);
+  trace->last = 0;
+}
+
+/*
+ * close_trace - unmaps a trace opened with open_trace
+ */
+void close_trace(trace_t* trace) {
+  if (trace->data != NULL) {
+    munmap((void*)trace->data, trace->end - trace->data);
+  }
+  trace->data = trace->pos = trace->end = NULL;
+}
+
+/*
+ * read_varint - decodes the varint at *p, advancing *p past it
+ * Returns false if the trace ends in the middle of it.
+ */
+static inline bool read_varint(const char** p, const char* end,
+                               mem_addr_t* value) {
+  mem_addr_t v = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char byte = *(*p)++;
+    v |= (mem_addr_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = v;
+      return true;
     }
+  }
+  return false;
+}
 
-    // check parent of the tail node
-    if (tagID == parentLine->tag && parentLine->valid) {
-      hit_cnt++;
-      // if parentLine isn't the head already, bring it to the front of the list
-      if (parentLine != cache[curSet]) {
-        bringNodeToFront(curSet, parentOfParentLine);
-      }
-      return;
+/*
+ * next_record - next_access for a binary trace
+ */
+char next_record(trace_t* trace, mem_addr_t* addr, unsigned int* len) {
+  static const char ops[4] = { 'L', 'S', 'M', 0 };
+  const char* p = trace->pos;
+  mem_addr_t size, delta;
+
+  if (p >= trace->end) return 0;
+  unsigned char head = *p++;
+  size = head >> 2;
+  if ((size == BIG_SIZE && !read_varint(&p, trace->end, &size)) ||
+      !read_varint(&p, trace->end, &delta) || ops[head & 3] == 0) {
+    fprintf(stderr, "corrupt binary trace at byte %ld\n",
+            (long)(trace->pos - trace->data));
+    exit(1);
+  }
+
+  // undo the zigzag, which maps small negative differences to small values
+  trace->last += (delta >> 1) ^ -(delta & 1);
+  trace->pos = p;
+  *addr = trace->last;
+  *len = size;
+  return ops[head & 3];
+}
+
+/*
+ * next_access - decodes the next data access of a trace. In a text trace
+ * it skips instruction loads and any other line whose second character
+ * isn't L, S or M. The address is hex and the size decimal, both read a
+ * character at a time, so a line costs no library calls.
+ * param - addr this is set to the address accessed
+ * param - len this is set to the number of bytes accessed
+ * Returns the type of access, L, S or M, or 0 at the end of the trace.
+ */
+char next_access(trace_t* trace, mem_addr_t* addr, unsigned int* len) {
+  if (trace->binary) {
+    return next_record(trace, addr, len);
+  }
+
+  const char* p = trace->pos;
+  const char* end = trace->end;
+
+  while (p < end) {
+    char op = end - p > 3 ? p[1] : 0;
+    if (op != 'L' && op != 'S' && op != 'M') {
+      // not a data access, skip the rest of the line
+      while (p < end && *p++ != '\n') {}
+      continue;
     }
-    // check tail node
-    if (tagID == parentLine->next->tag && parentLine->next->valid) {
-      hit_cnt++;
-      // bring node to the front of the list
-      bringNodeToFront(curSet, parentLine);
-      return;
+
+    // hex digits: '0'-'9' are below 10 after subtracting '0', and 'a'-'f'
+    // or 'A'-'F' are below 6 after folding case and subtracting 'a'
+    mem_addr_t value = 0;
+    p += 3;
+    for (; p < end; p++) {
+      unsigned int digit = (unsigned char)*p - '0';
+      if (digit >= 10) {
+        digit = ((unsigned char)*p | 0x20) - 'a';
+        if (digit >= 6) break;
+        digit += 10;
+      }
+      value = value << 4 | digit;
     }
 
-    // increment evict_cnt if tags don't match but v-bit is 1
-    if (parentLine->next->valid) {
-      evict_cnt++;
+    unsigned int size = 0;
+    if (p < end && *p == ',') {
+      for (p++; p < end && (unsigned char)(*p - '0') < 10; p++) {
+        size = size * 10 + (*p - '0');
+      }
     }
-    // increment miss_cnt
-    miss_cnt++;
-    // replace tail node with the new head node
-    parentLine->next->tag = tagID;
-    parentLine->next->valid = 1;
-    // set new head node's next to the old head node
-    parentLine->next->next = cache[curSet];
-    // have the set point to the new head node
-    cache[curSet] = parentLine->next;
-    parentLine->next = NULL;
+    while (p < end && *p++ != '\n') {}
+
+    trace->pos = p;
+    *addr = value;
+    *len = size;
+    return op;
   }
+
+  trace->pos = p;
+  return 0;
 }
 
 /*
  * replay_trace - replays the given trace file against the cache
- * reads the input trace file line by line
+ * decodes the input trace file access by access with next_access
  * extracts the type of each memory access : L/S/M
  * YOU MUST TRANSLATE one "L" as a load i.e. 1 memory access
  * YOU MUST TRANSLATE one "S" as a store i.e. 1 memory access
@@ -263,43 +465,362 @@ void access_data(mem_addr_t addr) {
  * accesses
  */
 void replay_trace(char* trace_fn) {
-  char buf[1000];
+  trace_t trace;
   mem_addr_t addr = 0;
   unsigned int len = 0;
-  FILE* trace_fp = fopen(trace_fn, "r");
+  char op;
+
+  open_trace(trace_fn, &trace);
+  while ((op = next_access(&trace, &addr, &len)) != 0) {
+    if (verbosity) printf("%c %llx,%u ", op, addr, len);
+
+    // now you have:
+    // 1. address accessed in variable - addr
+    // 2. type of acccess(S/L/M)  in variable - op
+    // call access_data function here depending on type of access
+    access_data(addr);
+    if (op == 'M') {
+      access_data(addr);
+    }
 
-  if (!trace_fp) {
-    fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+    if (verbosity) printf("\n");
+  }
+  close_trace(&trace);
+}
+
+/*
+ * load_trace - reads the addresses of all data accesses of a trace into
+ * memory, an M giving two of them
+ * param - count this is set to the number of addresses
+ * Returns the addresses, to be freed by the caller.
+ */
+mem_addr_t* load_trace(char* trace_fn, size_t* count) {
+  trace_t trace;
+  mem_addr_t addr = 0;
+  unsigned int len = 0;
+  size_t capacity = 1 << 16;
+  mem_addr_t* addrs = malloc(sizeof(mem_addr_t) * capacity);
+  char op;
+
+  if (addrs == NULL) {
+    printf("error allocating memory to trace\n");
     exit(1);
   }
 
-  while (fgets(buf, 1000, trace_fp) != NULL) {
-    if (buf[1] == 'S' || buf[1] == 'L' || buf[1] == 'M') {
-      sscanf(buf + 3, "%llx,%u", &addr, &len);
+  *count = 0;
+  open_trace(trace_fn, &trace);
+  while ((op = next_access(&trace, &addr, &len)) != 0) {
+    // leave room for the second access of an M
+    if (*count + 2 > capacity) {
+      capacity *= 2;
+      addrs = realloc(addrs, sizeof(mem_addr_t) * capacity);
+      if (addrs == NULL) {
+        printf("error allocating memory to trace\n");
+        exit(1);
+      }
+    }
+    addrs[(*count)++] = addr;
+    if (op == 'M') {
+      addrs[(*count)++] = addr;
+    }
+  }
+  close_trace(&trace);
+  return addrs;
+}
 
-      if (verbosity) printf("%c %llx,%u ", buf[1], addr, len);
+/*
+ * write_varint - appends value to a binary trace as a varint
+ */
+void write_varint(FILE* out_fp, mem_addr_t value) {
+  while (value >= 0x80) {
+    putc((value & 0x7f) | 0x80, out_fp);
+    value >>= 7;
+  }
+  putc(value, out_fp);
+}
 
-      // now you have:
-      // 1. address accessed in variable - addr
-      // 2. type of acccess(S/L/M)  in variable - buf[1]
-      // call access_data function here depending on type of access
-      access_data(addr);
-      if (buf[1] == 'M') {
-        access_data(addr);
+/*
+ * convert_trace - writes the data accesses of a trace to out_fn in the
+ * binary format, which replay_trace reads much faster than text
+ */
+void convert_trace(char* trace_fn, char* out_fn) {
+  trace_t trace;
+  mem_addr_t addr = 0;
+  mem_addr_t last = 0;
+  unsigned int len = 0;
+  size_t accesses = 0;
+  char op;
+  FILE* out_fp = fopen(out_fn, "wb");
+
+  if (!out_fp) {
+    fprintf(stderr, "%s: %s\n", out_fn, strerror(errno));
+    exit(1);
+  }
+
+  open_trace(trace_fn, &trace);
+  fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, out_fp);
+  while ((op = next_access(&trace, &addr, &len)) != 0) {
+    int code = op == 'L' ? 0 : op == 'S' ? 1 : 2;
+    putc(code | (len < BIG_SIZE ? len : BIG_SIZE) << 2, out_fp);
+    if (len >= BIG_SIZE) {
+      write_varint(out_fp, len);
+    }
+    // zigzag the difference so that small negative ones stay short
+    mem_addr_t delta = addr - last;
+    write_varint(out_fp, delta << 1 ^ -(delta >> 63));
+    last = addr;
+    accesses++;
+  }
+  size_t bytes = trace.end - trace.data;
+  close_trace(&trace);
+
+  if (fclose(out_fp) != 0) {
+    fprintf(stderr, "%s: %s\n", out_fn, strerror(errno));
+    exit(1);
+  }
+  printf("%s: %zu accesses, %zu bytes in %s\n", trace_fn, accesses, bytes,
+         out_fn);
+}
+
+/*
+ * time_parse - decodes the given trace over and over for at least a
+ * quarter of a second, without simulating it, and prints how fast
+ * next_access went through it
+ */
+void time_parse(char* trace_fn) {
+  trace_t trace;
+  mem_addr_t addr = 0;
+  unsigned int len = 0;
+  mem_addr_t checksum = 0;
+  size_t accesses = 0;
+  int rounds = 0;
+  double ns = 0;
+
+  open_trace(trace_fn, &trace);
+  size_t bytes = trace.end - trace.data;
+  while (ns < 2.5e8 || rounds == 0) {
+    struct timespec start, end;
+    rewind_trace(&trace);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (next_access(&trace, &addr, &len) != 0) {
+      checksum += addr + len;
+      accesses++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    rounds++;
+  }
+  close_trace(&trace);
+
+  printf("%s: %zu bytes, %zu accesses, %.1f MB/s, %.1f M accesses/s "
+         "(checksum %llx)\n", trace_fn, bytes, accesses / rounds,
+         bytes * rounds / (ns / 1e9) / 1e6, accesses / (ns / 1e9) / 1e6,
+         checksum);
+}
+
+/*
+ * run_benchmark - times access_data with every tag search kernel the CPU
+ * supports, for E = 1, 2, 4, ... 256 and the given s and b, on the trace
+ * held in memory so that reading it isn't timed. Each line shows the time
+ * per access and the counts, which must agree for all kernels.
+ */
+void run_benchmark(char* trace_fn) {
+  size_t count = 0;
+  mem_addr_t* addrs = load_trace(trace_fn, &count);
+
+  printf("%5s %-7s %10s %10s %10s %10s\n", "E", "kernel", "ns/access",
+         "hits", "misses", "evictions");
+  for (E = 1; E <= 256; E *= 2) {
+    for (int k = 0; k < NUM_KERNELS; k++) {
+      if (!kernel_supported(k)) continue;
+      find_line = kernels[k].find;
+      init_cache();
+      hit_cnt = miss_cnt = evict_cnt = 0;
+      access_clock = 0;
+
+      struct timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < count; i++) {
+        access_data(addrs[i]);
       }
+      clock_gettime(CLOCK_MONOTONIC, &end);
 
-      if (verbosity) printf("\n");
+      double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+                  (end.tv_nsec - start.tv_nsec);
+      printf("%5d %-7s %10.2f %10d %10d %10d\n", E, kernels[k].name,
+             ns / count, hit_cnt, miss_cnt, evict_cnt);
+      free_cache();
     }
   }
+  free(addrs);
+}
+
+/* Type: Sweep cache
+ * One cache of a sweep. While access_data runs it, its state is in the
+ * globals it uses, see swap_in and swap_out.
+ */
+typedef struct sweep_cache {
+  int s, E, b, S, t;
+  cache_t cache;
+  unsigned long long access_clock;
+  int hit_cnt, miss_cnt, evict_cnt;
+} sweep_cache_t;
+
+#define MAX_SWEEP_VALUES 64
+#define SWEEP_BATCH 4096
 
-  fclose(trace_fp);
+/*
+ * swap_in - makes the globals hold the state of cache c
+ */
+void swap_in(const sweep_cache_t* c) {
+  s = c->s;
+  E = c->E;
+  b = c->b;
+  S = c->S;
+  t = c->t;
+  cache = c->cache;
+  access_clock = c->access_clock;
+  hit_cnt = c->hit_cnt;
+  miss_cnt = c->miss_cnt;
+  evict_cnt = c->evict_cnt;
+}
+
+/*
+ * swap_out - saves the state of the globals to cache c
+ */
+void swap_out(sweep_cache_t* c) {
+  c->s = s;
+  c->E = E;
+  c->b = b;
+  c->S = S;
+  c->t = t;
+  c->cache = cache;
+  c->access_clock = access_clock;
+  c->hit_cnt = hit_cnt;
+  c->miss_cnt = miss_cnt;
+  c->evict_cnt = evict_cnt;
+}
+
+/*
+ * parse_values - reads a list of values such as "1,2,4" or "0-8" or both
+ * mixed like "1-3,8"
+ * param - values this gets the values, at most MAX_SWEEP_VALUES
+ * Returns the number of values, 0 if the list doesn't parse or a value is
+ * below min or above max.
+ */
+int parse_values(const char* list, int* values, int min, int max) {
+  int count = 0;
+  const char* p = list;
+
+  // each value ends the list or is followed by a comma and another value
+  for (;;) {
+    char* next;
+    long low = strtol(p, &next, 10);
+    long high = low;
+    if (next == p) return 0;
+    if (*next == '-') {
+      p = next + 1;
+      high = strtol(p, &next, 10);
+      if (next == p) return 0;
+    }
+    if (low < min || high > max || low > high ||
+        count + (high - low + 1) > MAX_SWEEP_VALUES) {
+      return 0;
+    }
+    for (long v = low; v <= high; v++) {
+      values[count++] = v;
+    }
+    if (*next == '\0') return count;
+    if (*next != ',') return 0;
+    p = next + 1;
+  }
+}
+
+/*
+ * run_sweep - simulates every combination of the given s, E and b values
+ * in one pass over the trace. The trace is decoded SWEEP_BATCH accesses at
+ * a time, and each batch is run through one cache after another, so a
+ * cache's sets and the batch stay in the simulator's own caches while it
+ * runs. Prints one line per cache, the print_summary output after its s, E
+ * and b.
+ */
+void run_sweep(char* trace_fn, const char* s_list, const char* E_list,
+               const char* b_list) {
+  int s_values[MAX_SWEEP_VALUES], E_values[MAX_SWEEP_VALUES];
+  int b_values[MAX_SWEEP_VALUES];
+  int s_count = parse_values(s_list, s_values, 0, 30);
+  int E_count = parse_values(E_list, E_values, 1, 1 << 16);
+  int b_count = parse_values(b_list, b_values, 1, 32);
+
+  if (s_count == 0 || E_count == 0 || b_count == 0) {
+    printf("sweep: -s, -E and -b take lists like 1,2,4 or 0-8\n");
+    exit(1);
+  }
+
+  // one cache per combination, each initialized as it would be alone
+  int count = s_count * E_count * b_count;
+  sweep_cache_t* caches = calloc(count, sizeof(sweep_cache_t));
+  mem_addr_t* batch = malloc(sizeof(mem_addr_t) * SWEEP_BATCH);
+  if (caches == NULL || batch == NULL) {
+    printf("error allocating memory to sweep\n");
+    exit(1);
+  }
+  int n = 0;
+  for (int i = 0; i < s_count; i++) {
+    for (int j = 0; j < E_count; j++) {
+      for (int k = 0; k < b_count; k++) {
+        s = s_values[i];
+        E = E_values[j];
+        b = b_values[k];
+        init_cache();
+        access_clock = 0;
+        hit_cnt = miss_cnt = evict_cnt = 0;
+        swap_out(&caches[n++]);
+      }
+    }
+  }
+
+  trace_t trace;
+  mem_addr_t addr = 0;
+  unsigned int len = 0;
+  size_t batch_size;
+  char op = 1;
+  open_trace(trace_fn, &trace);
+  do {
+    // an M gives two accesses, so stop one short of a full batch
+    for (batch_size = 0; batch_size + 1 < SWEEP_BATCH &&
+         (op = next_access(&trace, &addr, &len)) != 0;) {
+      batch[batch_size++] = addr;
+      if (op == 'M') {
+        batch[batch_size++] = addr;
+      }
+    }
+    for (int c = 0; c < count; c++) {
+      swap_in(&caches[c]);
+      for (size_t i = 0; i < batch_size; i++) {
+        access_data(batch[i]);
+      }
+      swap_out(&caches[c]);
+    }
+  } while (op != 0);
+  close_trace(&trace);
+
+  for (int c = 0; c < count; c++) {
+    swap_in(&caches[c]);
+    printf("s:%d E:%d b:%d ", s, E, b);
+    printf("hits:%d misses:%d evictions:%d\n", hit_cnt, miss_cnt, evict_cnt);
+    free_cache();
+  }
+  free(caches);
+  free(batch);
 }
 
 /*
  * print_usage - Print usage info
  */
 void print_usage(char* argv[]) {
-  printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+  printf("Usage: %s [-hvmp] -s <num> -E <num> -b <num> -t <file>"
+         " [-k <kernel>]\n", argv[0]);
   printf("Options:\n");
   printf("  -h         Print this help message.\n");
   printf("  -v         Optional verbose flag.\n");
@@ -307,9 +828,20 @@ void print_usage(char* argv[]) {
   printf("  -E <num>   Number of lines per set.\n");
   printf("  -b <num>   Number of block offset bits.\n");
   printf("  -t <file>  Trace file.\n");
+  printf("  -k <name>  Tag search kernel: avx2, sse4 or scalar.\n");
+  printf("  -m         Time the tag search kernels for E = 1 to 256.\n");
+  printf("  -p         Time parsing the trace only.\n");
+  printf("  --convert <file>  Write the trace to file in binary, which\n"
+         "                    csim detects and reads faster.\n");
+  printf("  --sweep    Simulate every combination of lists of -s, -E and -b\n"
+         "             values, like -s 0-8 -E 1,2,4, in one pass.\n");
   printf("\nExamples:\n");
   printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
   printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+  printf("  linux>  %s -m -s 0 -b 4 -t traces/long.trace\n", argv[0]);
+  printf("  linux>  %s -t traces/long.trace --convert long.bin\n", argv[0]);
+  printf("  linux>  %s --sweep -s 0-8 -E 1,2,4,8 -b 4-6"
+         " -t traces/long.trace\n", argv[0]);
   exit(0);
 }
 
@@ -331,21 +863,51 @@ void print_summary(int hits, int misses, int evictions) {
  */
 int main(int argc, char* argv[]) {
   char c;
-
-  // Parse the command line arguments: -h, -v, -s, -E, -b, -t
-  while ((c = getopt(argc, argv, "s:E:b:t:vh")) != -1) {
+  char* kernel_name = NULL;
+  int benchmark = 0;
+  int parse_only = 0;
+  char* convert_file = NULL;
+  int sweep = 0;
+  char* s_list = NULL;
+  char* E_list = NULL;
+  char* b_list = NULL;
+  static struct option long_options[] = {
+    { "convert", required_argument, NULL, 'c' },
+    { "sweep", no_argument, NULL, 'w' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  // Parse the command line arguments: -h, -v, -s, -E, -b, -t, -k, -m, -p,
+  // --convert, --sweep
+  while ((c = getopt_long(argc, argv, "s:E:b:t:k:vhmp", long_options,
+                          NULL)) != -1) {
     switch (c) {
       case 'b':
         b = atoi(optarg);
+        b_list = optarg;
+        break;
+      case 'c':
+        convert_file = optarg;
         break;
       case 'E':
         E = atoi(optarg);
+        E_list = optarg;
         break;
       case 'h':
         print_usage(argv);
         exit(0);
+      case 'k':
+        kernel_name = optarg;
+        break;
+      case 'm':
+        benchmark = 1;
+        break;
+      case 'p':
+        parse_only = 1;
+        break;
       case 's':
         s = atoi(optarg);
+        s_list = optarg;
         break;
       case 't':
         trace_file = optarg;
@@ -353,19 +915,47 @@ int main(int argc, char* argv[]) {
       case 'v':
         verbosity = 1;
         break;
+      case 'w':
+        sweep = 1;
+        break;
       default:
         print_usage(argv);
         exit(1);
     }
   }
 
-  /* Make sure that all required command line args were specified */
-  if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
+  // Detect the CPU once, before any kernel is chosen
+  __builtin_cpu_init();
+
+  if (convert_file != NULL && trace_file != NULL) {
+    convert_trace(trace_file, convert_file);
+    return 0;
+  }
+  if (parse_only && trace_file != NULL) {
+    time_parse(trace_file);
+    return 0;
+  }
+  if (sweep && s_list != NULL && E_list != NULL && b_list != NULL &&
+      trace_file != NULL) {
+    select_kernel(kernel_name);
+    run_sweep(trace_file, s_list, E_list, b_list);
+    return 0;
+  }
+
+  /* Make sure that all required command line args were specified, s may be
+   * 0 for a fully associative cache */
+  if (s < 0 || (E == 0 && !benchmark) || b == 0 || trace_file == NULL) {
     printf("%s: Missing required command line argument\n", argv[0]);
     print_usage(argv);
     exit(1);
   }
 
+  if (benchmark) {
+    run_benchmark(trace_file);
+    return 0;
+  }
+  select_kernel(kernel_name);
+
   /* Initialize cache */
   init_cache();
 